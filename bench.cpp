@@ -0,0 +1,341 @@
+#include <cstdint>
+
+#include <random>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "matcher.hpp"
+#include "regexplib.hpp"
+
+#include "benchmark/benchmark.h"
+
+namespace
+{
+
+constexpr size_t kInputSize = 1 << 20;
+
+constexpr regexp::engine kEngines[] = {
+    regexp::engine::backtrack,
+    regexp::engine::nfa,
+    regexp::engine::dfa,
+};
+
+// the engines run alone, the argument past them runs the default options as planned
+regexp::options options_of(benchmark::State const& state)
+{
+    if (std::size(kEngines) == static_cast<size_t>(state.range(0)))
+        return {.prefilter = false};
+    return {.engine = kEngines[state.range(0)], .prefilter = false, .plan = false};
+}
+
+void set_engine_label(benchmark::State& state)
+{
+    char const* const names[] = {"backtrack", "nfa", "dfa", "planned"};
+    state.SetLabel(names[state.range(0)]);
+}
+
+// lines of a service log, a few percent of them are errors and some of those mention a timeout
+std::vector<std::string> const& log_corpus()
+{
+    static auto const lines = [] {
+        std::mt19937 gen{42};
+        char const* const levels[]   = {"DEBUG", "INFO", "INFO", "INFO", "WARN"};
+        char const* const services[] = {"auth", "billing", "gateway", "search", "storage"};
+        char const* const messages[] = {
+            "request served",
+            "cache miss for key",
+            "connection reused",
+            "upstream timeout after retry",
+            "slow query detected",
+        };
+
+        std::vector<std::string> lines;
+        for (size_t size = 0; size < kInputSize;) {
+            auto line = "2024-03-" + std::to_string(gen() % 28 + 10) + "T" +
+                        std::to_string(gen() % 14 + 10) + ":" + std::to_string(gen() % 50 + 10) +
+                        ":" + std::to_string(gen() % 50 + 10) + " " +
+                        (gen() % 50 ? levels[gen() % std::size(levels)] : "ERROR") + " " +
+                        services[gen() % std::size(services)] +
+                        " id=" + std::to_string(gen() % 1000000) + " " +
+                        messages[gen() % std::size(messages)] + " took " +
+                        std::to_string(gen() % 2000) + "ms";
+            size += line.size() + 1;
+            lines.push_back(std::move(line));
+        }
+        return lines;
+    }();
+    return lines;
+}
+
+size_t corpus_bytes(std::vector<std::string> const& lines)
+{
+    size_t bytes = 0;
+    for (auto const& line : lines)
+        bytes += line.size();
+    return bytes;
+}
+
+void BM_ConvertToTable(benchmark::State& state)
+{
+    std::string_view const p = "[abc]{2,5}\\d+x*y?.*ERROR \\w+ [^\\s]{1,16}timeout.*";
+    for (auto _ : state)
+        benchmark::DoNotOptimize(regexp::detail::convert_to_table(p));
+}
+BENCHMARK(BM_ConvertToTable);
+
+void BM_CompilePattern(benchmark::State& state)
+{
+    set_engine_label(state);
+    std::string_view const p = "[abc]{2,5}\\d+x*y?.*ERROR \\w+ [^\\s]{1,16}timeout.*";
+    for (auto _ : state)
+        benchmark::DoNotOptimize(regexp::pattern{p, options_of(state)});
+}
+BENCHMARK(BM_CompilePattern)->DenseRange(0, 2);
+
+void BM_LoadPatternFromMemory(benchmark::State& state)
+{
+    set_engine_label(state);
+    std::string_view const p = "[abc]{2,5}\\d+x*y?.*ERROR \\w+ [^\\s]{1,16}timeout.*";
+    auto const image         = regexp::pattern{p}.save();
+    for (auto _ : state)
+        benchmark::DoNotOptimize(regexp::pattern::load_from_memory(image, options_of(state)));
+}
+BENCHMARK(BM_LoadPatternFromMemory)->DenseRange(0, 2);
+
+void BM_CompileStdRegex(benchmark::State& state)
+{
+    char const* const p = "[abc]{2,5}\\d+x*y?.*ERROR \\w+ [^\\s]{1,16}timeout.*";
+    for (auto _ : state)
+        benchmark::DoNotOptimize(std::regex{p});
+}
+BENCHMARK(BM_CompileStdRegex);
+
+// every matcher type of the table alone on an input it consumes whole
+void run_matcher(benchmark::State& state, std::string const& p, std::string const& s)
+{
+    set_engine_label(state);
+    regexp::pattern const pattern{p, options_of(state)};
+    for (auto _ : state) {
+        if (!pattern.match(s)) {
+            state.SkipWithError("input is not matched");
+            break;
+        }
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * s.size()));
+}
+
+void BM_MatcherRangeStrict(benchmark::State& state)
+{
+    std::string s;
+    for (size_t i = 0; i < kInputSize / 256; ++i)
+        s += static_cast<char>('a' + i % 26);
+    run_matcher(state, s, s);
+}
+BENCHMARK(BM_MatcherRangeStrict)->DenseRange(0, 3);
+
+void BM_MatcherSpecChar(benchmark::State& state)
+{
+    run_matcher(state, "a*", std::string(kInputSize, 'a'));
+}
+BENCHMARK(BM_MatcherSpecChar)->DenseRange(0, 3);
+
+void BM_MatcherAnyChar(benchmark::State& state)
+{
+    run_matcher(state, ".*", std::string(kInputSize, 'a'));
+}
+BENCHMARK(BM_MatcherAnyChar)->DenseRange(0, 3);
+
+void BM_MatcherOneOfPositive(benchmark::State& state)
+{
+    std::string s(kInputSize, 'a');
+    for (size_t i = 0; i < s.size(); i += 3)
+        s[i] = 'c';
+    run_matcher(state, "[abc]*", s);
+}
+BENCHMARK(BM_MatcherOneOfPositive)->DenseRange(0, 3);
+
+void BM_MatcherOneOfNegative(benchmark::State& state)
+{
+    std::string s(kInputSize, 'a');
+    for (size_t i = 0; i < s.size(); i += 3)
+        s[i] = 'c';
+    run_matcher(state, "[^xyz]*", s);
+}
+BENCHMARK(BM_MatcherOneOfNegative)->DenseRange(0, 3);
+
+void BM_LongClassRun(benchmark::State& state)
+{
+    std::string s;
+    for (size_t i = 0; i < kInputSize; ++i)
+        s += "abcdefghijklmnopqrstuvwxyz0123456789_"[i % 37];
+    s += ' ';
+    run_matcher(state, "\\w+\\s", s);
+}
+BENCHMARK(BM_LongClassRun)->DenseRange(0, 3);
+
+void BM_StdRegexLongClassRun(benchmark::State& state)
+{
+    std::string s;
+    // std::regex recurses on every repetition, longer runs overflow the stack
+    for (size_t i = 0; i < kInputSize / 256; ++i)
+        s += "abcdefghijklmnopqrstuvwxyz0123456789_"[i % 37];
+    s += ' ';
+    std::regex const re{"\\w+\\s"};
+    for (auto _ : state)
+        benchmark::DoNotOptimize(std::regex_match(s, re));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * s.size()));
+}
+BENCHMARK(BM_StdRegexLongClassRun);
+
+// a*[ab]*a*...b on a run of a's, exponential for a naive backtracker, repeats of the very same
+// item are folded by the converter so they alternate
+std::string pathological_pattern(int64_t stars)
+{
+    std::string p;
+    for (int64_t i = 0; i < stars; ++i)
+        p += i % 2 ? "[ab]*" : "a*";
+    return p + "b";
+}
+
+void BM_Pathological(benchmark::State& state)
+{
+    set_engine_label(state);
+    auto const p = pathological_pattern(state.range(1));
+    std::string const s(static_cast<size_t>(state.range(2)), 'a');
+    regexp::pattern const pattern{p, options_of(state)};
+    for (auto _ : state)
+        benchmark::DoNotOptimize(pattern.match(s));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * s.size()));
+}
+BENCHMARK(BM_Pathological)
+    ->ArgsProduct({{0, 1, 2}, {3, 6}, {24}})
+    ->ArgsProduct({{1, 2}, {8}, {4096}});
+
+void BM_PathologicalMemoized(benchmark::State& state)
+{
+    auto const p = pathological_pattern(state.range(0));
+    std::string const s(static_cast<size_t>(state.range(1)), 'a');
+    regexp::pattern const pattern{p, {.prefilter = false, .memoize = true}};
+    for (auto _ : state)
+        benchmark::DoNotOptimize(pattern.match(s));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * s.size()));
+}
+BENCHMARK(BM_PathologicalMemoized)->Args({6, 24})->Args({8, 1024});
+
+void BM_StdRegexPathological(benchmark::State& state)
+{
+    std::regex const re{pathological_pattern(state.range(0))};
+    std::string const s(static_cast<size_t>(state.range(1)), 'a');
+    for (auto _ : state)
+        benchmark::DoNotOptimize(std::regex_match(s, re));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * s.size()));
+}
+BENCHMARK(BM_StdRegexPathological)->Args({3, 24})->Args({6, 24});
+
+void BM_LogCorpus(benchmark::State& state)
+{
+    set_engine_label(state);
+    auto const& lines = log_corpus();
+    auto opts      = options_of(state);
+    opts.prefilter = 0 != state.range(1);
+    regexp::pattern const pattern{".*ERROR \\w+ id=\\d+ .*timeout.*", opts};
+    for (auto _ : state) {
+        size_t matched = 0;
+        for (auto const& line : lines)
+            matched += pattern.match(line);
+        benchmark::DoNotOptimize(matched);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * corpus_bytes(lines)));
+}
+BENCHMARK(BM_LogCorpus)->ArgsProduct({{0, 1, 2, 3}, {0, 1}});
+
+void BM_LogCorpusJit(benchmark::State& state)
+{
+    auto const& lines = log_corpus();
+    regexp::pattern const pattern{
+        ".*ERROR \\w+ id=\\d+ .*timeout.*", {.prefilter = 0 != state.range(0), .jit = true}};
+    for (auto _ : state) {
+        size_t matched = 0;
+        for (auto const& line : lines)
+            matched += pattern.match(line);
+        benchmark::DoNotOptimize(matched);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * corpus_bytes(lines)));
+    if (auto const t = pattern.jit_compile_time())
+        state.counters["jit_compile_ns"] = static_cast<double>(t->count());
+}
+BENCHMARK(BM_LogCorpusJit)->Arg(0)->Arg(1);
+
+void BM_LogCorpusSearch(benchmark::State& state)
+{
+    set_engine_label(state);
+    auto const& lines = log_corpus();
+    regexp::pattern const pattern{"took \\d{4}ms", options_of(state)};
+    for (auto _ : state) {
+        size_t matched = 0;
+        for (auto const& line : lines)
+            matched += pattern.search(line);
+        benchmark::DoNotOptimize(matched);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * corpus_bytes(lines)));
+}
+BENCHMARK(BM_LogCorpusSearch)->DenseRange(0, 3);
+
+void BM_LogCorpusBatch(benchmark::State& state)
+{
+    set_engine_label(state);
+    auto const& lines = log_corpus();
+
+    std::string data;
+    std::vector<size_t> offsets{0};
+    for (auto const& line : lines) {
+        data += line;
+        offsets.push_back(data.size());
+    }
+    std::vector<uint64_t> bits((lines.size() + 63) / 64);
+
+    regexp::pattern const pattern{
+        ".*ERROR \\w+ id=\\d+ .*timeout.*", {.engine = kEngines[state.range(0)], .plan = false}};
+    for (auto _ : state) {
+        pattern.match_batch(
+            data.data(), offsets.data(), lines.size(), bits.data(),
+            static_cast<unsigned>(state.range(1)));
+        benchmark::DoNotOptimize(bits.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * data.size()));
+}
+BENCHMARK(BM_LogCorpusBatch)->ArgsProduct({{0, 1, 2}, {1, 4}})->UseRealTime();
+
+void BM_StdRegexLogCorpus(benchmark::State& state)
+{
+    auto const& lines = log_corpus();
+    std::regex const re{".*ERROR \\w+ id=\\d+ .*timeout.*"};
+    for (auto _ : state) {
+        size_t matched = 0;
+        for (auto const& line : lines)
+            matched += std::regex_match(line, re);
+        benchmark::DoNotOptimize(matched);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * corpus_bytes(lines)));
+}
+BENCHMARK(BM_StdRegexLogCorpus);
+
+void BM_StdRegexLogCorpusSearch(benchmark::State& state)
+{
+    auto const& lines = log_corpus();
+    std::regex const re{"took \\d{4}ms"};
+    for (auto _ : state) {
+        size_t matched = 0;
+        for (auto const& line : lines)
+            matched += std::regex_search(line, re);
+        benchmark::DoNotOptimize(matched);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * corpus_bytes(lines)));
+}
+BENCHMARK(BM_StdRegexLogCorpusSearch);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,373 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace regexp::detail::ct
+{
+
+template <std::size_t N>
+struct fixed_string {
+    constexpr fixed_string(char const (&s)[N]) noexcept
+    {
+        for (std::size_t i = 0; i < N; ++i)
+            data[i] = s[i];
+    }
+
+    constexpr std::size_t size() const noexcept { return N - 1; }
+    constexpr std::string_view view() const noexcept { return {data, N - 1}; }
+
+    char data[N]{};
+};
+
+enum class kind : uint8_t {
+    range_strict,
+    spec_char,
+    any_char,
+    one_of_char_positive,
+    one_of_char_negative,
+};
+
+struct matcher {
+    kind k;
+    uint32_t m, n;
+    char c;
+    // literal of a strict range as offsets into the pattern
+    uint32_t first, last;
+    std::array<uint64_t, 4> cs;
+
+    constexpr bool allows_zero_occurrences() const noexcept
+    {
+        return kind::range_strict != k && 0 == m;
+    }
+
+    constexpr bool accepts(char ch) const noexcept
+    {
+        auto const b = static_cast<unsigned char>(ch);
+        switch (k) {
+            case kind::spec_char:
+                return c == ch;
+            case kind::any_char:
+                return true;
+            case kind::one_of_char_positive:
+                return cs[b >> 6] >> (b & 63) & 1;
+            case kind::one_of_char_negative:
+                return !(cs[b >> 6] >> (b & 63) & 1);
+            default:
+                return false;
+        }
+    }
+};
+
+// a pattern of N characters converts to at most N + 1 matchers
+template <std::size_t N>
+struct matcher_table {
+    std::array<matcher, N> matchers{};
+    std::size_t size = 0;
+
+    constexpr void push_back(matcher const& m) { matchers[size++] = m; }
+    constexpr void pop_back() noexcept { --size; }
+    constexpr bool empty() const noexcept { return 0 == size; }
+    constexpr matcher& back() noexcept { return matchers[size - 1]; }
+};
+
+constexpr uint32_t kInf = std::numeric_limits<uint32_t>::max();
+
+constexpr matcher make_strict(std::size_t f, std::size_t l)
+{
+    return {
+        kind::range_strict, 1, 1, 0, static_cast<uint32_t>(f), static_cast<uint32_t>(l), {}};
+}
+
+constexpr matcher make_spec_char(char c, uint32_t m, uint32_t n)
+{
+    return {kind::spec_char, m, n, c, 0, 0, {}};
+}
+
+constexpr matcher make_any_char(uint32_t m, uint32_t n)
+{
+    return {kind::any_char, m, n, 0, 0, 0, {}};
+}
+
+constexpr matcher make_one_of(std::string_view chars, bool negate)
+{
+    auto const k = negate ? kind::one_of_char_negative : kind::one_of_char_positive;
+    matcher r{k, 1, 1, 0, 0, 0, {}};
+    for (auto const ch : chars) {
+        auto const b = static_cast<unsigned char>(ch);
+        r.cs[b >> 6] |= uint64_t{1} << (b & 63);
+    }
+    return r;
+}
+
+/*
+ * The one converter of patterns into matchers, run by the runtime patterns
+ * on a vector and constant-evaluated by static_pattern on a matcher_table.
+ * A table is anything with push_back, pop_back, empty and back. Errors
+ * thrown in constant evaluation turn into compile errors.
+ */
+template <typename Table>
+constexpr void convert(std::string_view p, Table& table)
+{
+    enum {
+        kDefault,
+        kOneOf,
+        kOneOfSpecSym,
+        kOccurrencesSpecMin,
+        kOccurrencesSpecMax,
+    } mode = kDefault;
+
+    std::size_t f = 0, i = 0, l = p.size();
+    uint32_t m = 0, n = 0;
+
+    auto const quantifier = [&](uint32_t& qm, uint32_t& qn) {
+        if (i + 1 >= l)
+            return;
+        switch (p[i + 1]) {
+            case '{':
+                m = 0, n = 0;
+                ++i;
+                mode = kOccurrencesSpecMin;
+                break;
+            case '*':
+                qm = 0, qn = kInf;
+                ++i;
+                break;
+            case '+':
+                qm = 1, qn = kInf;
+                ++i;
+                break;
+            case '?':
+                qm = 0, qn = 1;
+                ++i;
+                break;
+            default:
+                break;
+        }
+    };
+
+    for (;; ++i) {
+        switch (mode) {
+            case kDefault: {
+                if (i >= l) {
+                    if (f < i)
+                        table.push_back(make_strict(f, i));
+                    return;
+                }
+
+                switch (auto const c = p[i]; c) {
+                    case '[':
+                    case '\\':
+                        if (f < i)
+                            table.push_back(make_strict(f, i));
+                        f    = i + 1;
+                        mode = '[' == c ? kOneOf : kOneOfSpecSym;
+                        break;
+                    case '*':
+                    case '+':
+                    case '?':
+                    case '{': {
+                        if (f == i)
+                            throw std::invalid_argument(
+                                std::string{"unexpected '"} + c +
+                                "' without previous symbol or expression");
+
+                        if (f < i - 1)
+                            table.push_back(make_strict(f, i - 1));
+
+                        auto const pc = p[i - 1];
+                        if ('{' == c) {
+                            table.push_back(
+                                '.' == pc ? make_any_char(1, 1) : make_spec_char(pc, 1, 1));
+                            m = 0, n = 0;
+                            mode = kOccurrencesSpecMin;
+                        } else if ('.' == pc) {
+                            // an unbounded wildcard matches whatever optional matchers before it do
+                            while ('?' != c && !table.empty() &&
+                                   table.back().allows_zero_occurrences())
+                                table.pop_back();
+                            table.push_back(make_any_char(0, '?' == c ? 1 : kInf));
+                            if ('+' == c)
+                                table.push_back(make_any_char(1, 1));
+                        } else {
+                            auto const is_zero_more = [&](kind k) {
+                                auto const& b = table.back();
+                                return k == b.k && 0 == b.m && (kind::any_char == k || pc == b.c);
+                            };
+                            if (table.empty() ||
+                                !is_zero_more(kind::any_char) && !is_zero_more(kind::spec_char))
+                                table.push_back(make_spec_char(pc, 0, '?' == c ? 1 : kInf));
+                            if ('+' == c)
+                                table.push_back(make_spec_char(pc, 1, 1));
+                        }
+
+                        f = i + 1;
+                    } break;
+                    case ']':
+                        throw std::invalid_argument(
+                            "unexpected ']' in not opened oneof [] expression");
+                    case '}':
+                        throw std::invalid_argument(
+                            "unexpected '}' in not opened occurrences specifier {} expression");
+                    default:
+                        break;
+                }
+            } break;
+            case kOneOf: {
+                if (i >= l)
+                    throw std::invalid_argument("not terminated oneof [] expression");
+
+                switch (auto const c = p[i]; c) {
+                    case ']': {
+                        bool const negate = '^' == p[f];
+                        if (negate)
+                            ++f;
+
+                        if (f == i)
+                            throw std::invalid_argument(
+                                "empty oneof [] expression is impossible");
+
+                        auto one_of = make_one_of(p.substr(f, i - f), negate);
+                        mode        = kDefault;
+                        quantifier(one_of.m, one_of.n);
+                        table.push_back(one_of);
+                        f = i + 1;
+                    } break;
+                    case '^':
+                        if (f == i)
+                            break;
+                        [[fallthrough]];
+                    case '[':
+                        throw std::invalid_argument(
+                            std::string{"unexpected '"} + c +
+                            "' inside opened oneof [] expression");
+                    default:
+                        break;
+                }
+            } break;
+            case kOneOfSpecSym: {
+                if (i >= l)
+                    throw std::invalid_argument("not terminated oneof [] expression");
+
+                matcher one_of{};
+                switch (auto const c = p[i]; c) {
+                    case 'd':
+                    case 'D':
+                        one_of = make_one_of("0123456789", 'D' == c);
+                        break;
+                    case 'w':
+                    case 'W':
+                        one_of = make_one_of(
+                            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_",
+                            'W' == c);
+                        break;
+                    case 's':
+                    case 'S':
+                        one_of = make_one_of(" \f\n\t\v", 'S' == c);
+                        break;
+                    case 't':
+                        one_of = make_one_of("\t", false);
+                        break;
+                    case 'r':
+                        one_of = make_one_of("\r", false);
+                        break;
+                    case 'n':
+                        one_of = make_one_of("\n", false);
+                        break;
+                    case 'v':
+                        one_of = make_one_of("\v", false);
+                        break;
+                    case 'f':
+                        one_of = make_one_of("\f", false);
+                        break;
+                    case '0':
+                        one_of = make_one_of({"\0", 1}, false);
+                        break;
+                    case '\\':
+                        one_of = make_one_of("\\", false);
+                        break;
+                    default:
+                        throw std::invalid_argument(
+                            std::string{"invalid a special control symbol '"} + c + "' after \\");
+                }
+
+                mode = kDefault;
+                quantifier(one_of.m, one_of.n);
+                table.push_back(one_of);
+                f = i + 1;
+            } break;
+            case kOccurrencesSpecMin:
+                if (i >= l)
+                    throw std::invalid_argument(
+                        "not terminated occurrences specifier {} expression");
+
+                switch (auto const c = p[i]; c) {
+                    case '0' ... '9':
+                        m = m * 10 + c - '0';
+                        break;
+                    case '}':
+                        if (f == i)
+                            throw std::invalid_argument(
+                                "empty occurrences specifier {} expression is impossible");
+                        n              = m;
+                        table.back().m = m;
+                        table.back().n = n;
+                        f              = i + 1;
+                        mode           = kDefault;
+                        break;
+                    case ',':
+                        n    = 0;
+                        f    = i + 1;
+                        mode = kOccurrencesSpecMax;
+                        break;
+                    default:
+                        throw std::invalid_argument(
+                            std::string{"unexpected '"} + c +
+                            "' inside opened occurrences specifier {} expression");
+                }
+                break;
+            case kOccurrencesSpecMax:
+                if (i >= l)
+                    throw std::invalid_argument(
+                        "not terminated occurrences specifier {} expression");
+
+                switch (auto const c = p[i]; c) {
+                    case '0' ... '9':
+                        n = n * 10 + c - '0';
+                        break;
+                    case '}':
+                        n = n ?: kInf;
+                        if (m > n)
+                            throw std::invalid_argument(
+                                "range specified in occurrences specifier {} expression is "
+                                "invalid");
+                        table.back().m = m;
+                        table.back().n = n;
+                        f              = i + 1;
+                        mode           = kDefault;
+                        break;
+                    default:
+                        throw std::invalid_argument(
+                            std::string{"unexpected '"} + c +
+                            "' inside opened occurrences specifier {} expression");
+                }
+                break;
+        }
+    }
+}
+
+template <std::size_t N>
+constexpr matcher_table<N + 1> convert_to_table(std::string_view p)
+{
+    matcher_table<N + 1> table;
+    convert(p, table);
+    return table;
+}
+
+} // namespace regexp::detail::ct
@@ -0,0 +1,219 @@
+#include "dfa.hpp"
+
+#include <cstdint>
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+#include <unordered_set>
+#include <utility>
+
+namespace
+{
+
+constexpr uint32_t kUnanchoredMark = std::numeric_limits<uint32_t>::max();
+
+constexpr uint8_t kAccepting = 1 << 0;
+constexpr uint8_t kDead      = 1 << 1;
+
+} // namespace
+
+namespace regexp::detail
+{
+
+size_t dfa::key_hash::operator()(std::vector<uint32_t> const& key) const noexcept
+{
+    uint64_t h = 14695981039346656037ull;
+    for (auto const v : key)
+        h = (h ^ v) * 1099511628211ull;
+    return static_cast<size_t>(h);
+}
+
+dfa::dfa(nfa const& automaton, size_t cache_size)
+    : nfa_(automaton)
+    , cache_size_(cache_size)
+{
+    std::array<uint32_t, 256> classes{};
+    std::unordered_set<charset, charset_hash> refined;
+    for (auto const& p : nfa_.positions()) {
+        if (!refined.insert(p.cs).second)
+            continue;
+
+        for (uint32_t b = 0; b < classes.size(); ++b) {
+            if (p.cs.test(static_cast<char>(b)))
+                classes[b] |= 1u << 31;
+        }
+
+        std::array<uint32_t, 512> renumber;
+        renumber.fill(kUnanchoredMark);
+        uint32_t qty = 0;
+        for (auto& cls : classes) {
+            auto const i = (cls & 0xff) | (cls >> 31) << 8;
+            if (kUnanchoredMark == renumber[i])
+                renumber[i] = qty++;
+            cls = renumber[i];
+        }
+    }
+
+    for (uint32_t b = 0; b < classes.size(); ++b) {
+        byte_classes_[b] = static_cast<uint8_t>(classes[b]);
+        classes_qty_     = std::max(classes_qty_, classes[b] + 1);
+    }
+}
+
+size_t dfa::state_cost(size_t set_size) const noexcept
+{
+    return classes_qty_ * sizeof(state_id_t) + set_size * sizeof(uint32_t) + 64;
+}
+
+void dfa::cache::flush()
+{
+    transitions_.clear();
+    sets_.clear();
+    flags_.clear();
+    states_.clear();
+    starts_.fill(kUnknown);
+    used_ = 0;
+    ++flushes_;
+}
+
+dfa::state_id_t dfa::add_state(cache& c, std::vector<uint32_t> key) const
+{
+    if (auto const it = c.states_.find(key); it != c.states_.end())
+        return it->second;
+
+    auto const cost = state_cost(key.size());
+    if (!c.states_.empty() && c.used_ + cost > cache_size_)
+        c.flush();
+    c.used_ += cost;
+
+    auto const id = static_cast<state_id_t>(c.sets_.size());
+    auto const it = c.states_.emplace(std::move(key), id).first;
+
+    auto const& set = it->first;
+    auto const last = set.empty() || kUnanchoredMark != set.back() ? set.end() : set.end() - 1;
+
+    uint8_t flags = 0;
+    if (set.begin() == last)
+        flags |= kDead;
+    else if (nfa_.accepting() == last[-1])
+        flags |= kAccepting;
+
+    c.transitions_.resize(c.transitions_.size() + classes_qty_, kUnknown);
+    c.sets_.push_back(&set);
+    c.flags_.push_back(flags);
+
+    return id;
+}
+
+dfa::state_id_t dfa::start_state(cache& c, bool unanchored) const
+{
+    if (kUnknown != c.starts_[unanchored])
+        return c.starts_[unanchored];
+
+    sparse_set states{nfa_.accepting() + 1};
+    nfa_.add_closure(states, 0);
+
+    std::vector<uint32_t> key{states.begin(), states.end()};
+    std::sort(key.begin(), key.end());
+    if (unanchored)
+        key.push_back(kUnanchoredMark);
+
+    return c.starts_[unanchored] = add_state(c, std::move(key));
+}
+
+dfa::state_id_t dfa::next_state(cache& c, state_id_t from, unsigned char ch) const
+{
+    sparse_set current{nfa_.accepting() + 1}, next{nfa_.accepting() + 1};
+
+    bool unanchored = false;
+    for (auto const b : *c.sets_[from]) {
+        if (kUnanchoredMark == b)
+            unanchored = true;
+        else
+            current.insert(b);
+    }
+
+    nfa_.step(current, next, ch);
+    if (unanchored)
+        nfa_.add_closure(next, 0);
+
+    std::vector<uint32_t> key{next.begin(), next.end()};
+    std::sort(key.begin(), key.end());
+    if (unanchored)
+        key.push_back(kUnanchoredMark);
+
+    auto const flushes = c.flushes_;
+    auto const to      = add_state(c, std::move(key));
+    if (flushes == c.flushes_)
+        c.transitions_[from * classes_qty_ + byte_classes_[ch]] = to;
+
+    return to;
+}
+
+template <bool kUnanchored>
+int dfa::run(cache& c, std::string_view s) const
+{
+    auto st = start_state(c, kUnanchored);
+
+    size_t last_flush  = 0;
+    auto const flushes = c.flushes_;
+    for (size_t i = 0; i < s.size(); ++i) {
+        if constexpr (kUnanchored) {
+            if (c.flags_[st] & kAccepting)
+                return 1;
+        }
+
+        auto const ch = static_cast<unsigned char>(s[i]);
+        auto next     = c.transitions_[st * classes_qty_ + byte_classes_[ch]];
+        if (kUnknown == next) {
+            auto const states = c.sets_.size();
+            next              = next_state(c, st, ch);
+            if (c.flushes_ != flushes) {
+                // the cache is thrashing, the automaton simulation is cheaper
+                if (c.flushes_ - flushes > 1 && i - last_flush < 10 * states)
+                    return -1;
+                last_flush = i;
+            }
+        }
+        st = next;
+
+        if constexpr (!kUnanchored) {
+            if (c.flags_[st] & kDead)
+                return 0;
+        }
+    }
+
+    return c.flags_[st] & kAccepting ? 1 : 0;
+}
+
+bool dfa::match(std::string_view s, cache& c, nfa::buffers& b) const
+{
+    auto const r = run<false>(c, s);
+    return r < 0 ? nfa_.match(s, b) : 1 == r;
+}
+
+uint64_t dfa::match_rows(
+    char const* data,
+    size_t const* offsets,
+    uint64_t rows,
+    cache& c,
+    nfa::buffers& b) const
+{
+    uint64_t matched = 0;
+    for (; rows; rows &= rows - 1) {
+        auto const i = std::countr_zero(rows);
+        std::string_view const row{data + offsets[i], offsets[i + 1] - offsets[i]};
+        if (auto const r = run<false>(c, row); r < 0 ? nfa_.match(row, b) : 1 == r)
+            matched |= uint64_t{1} << i;
+    }
+    return matched;
+}
+
+bool dfa::search(std::string_view s, cache& c, nfa::buffers& b) const
+{
+    auto const r = run<true>(c, s);
+    return r < 0 ? nfa_.search(s, b) : 1 == r;
+}
+
+} // namespace regexp::detail
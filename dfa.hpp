@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "nfa.hpp"
+
+namespace regexp::detail
+{
+
+/*
+ * Lazily built deterministic automaton over the states of a position
+ * automaton. States and their transitions are created on demand and kept in
+ * a cache limited by a memory budget; the whole cache is flushed when a new
+ * state would not fit. If the budget is too small to make progress the
+ * matcher falls back to the position automaton simulation. The automaton
+ * itself never changes, every thread running it brings its own cache.
+ */
+class dfa
+{
+public:
+    static constexpr size_t default_cache_size = 1 << 20;
+
+    class cache;
+
+    dfa(nfa const& automaton, size_t cache_size = default_cache_size);
+
+    bool match(std::string_view s, cache& c, nfa::buffers& b) const;
+    // matches the rows [data + offsets[i], data + offsets[i + 1]) for every bit i set in rows
+    uint64_t match_rows(
+        char const* data,
+        size_t const* offsets,
+        uint64_t rows,
+        cache& c,
+        nfa::buffers& b) const;
+    bool search(std::string_view s, cache& c, nfa::buffers& b) const;
+
+private:
+    using state_id_t = int32_t;
+
+    static constexpr state_id_t kUnknown = -1;
+
+    struct key_hash {
+        size_t operator()(std::vector<uint32_t> const& key) const noexcept;
+    };
+
+    state_id_t start_state(cache& c, bool unanchored) const;
+    state_id_t next_state(cache& c, state_id_t from, unsigned char ch) const;
+    state_id_t add_state(cache& c, std::vector<uint32_t> key) const;
+    size_t state_cost(size_t set_size) const noexcept;
+
+    template <bool kUnanchored>
+    int run(cache& c, std::string_view s) const;
+
+    nfa const& nfa_;
+    size_t const cache_size_;
+
+    std::array<uint8_t, 256> byte_classes_{};
+    uint32_t classes_qty_ = 0;
+};
+
+// states and transitions of a dfa built so far, used by one thread at a time
+class dfa::cache
+{
+public:
+    // estimated bytes of the states built so far
+    size_t size() const noexcept { return used_; }
+
+private:
+    friend class dfa;
+
+    void flush();
+
+    std::vector<state_id_t> transitions_;
+    std::vector<std::vector<uint32_t> const*> sets_;
+    std::vector<uint8_t> flags_;
+    std::unordered_map<std::vector<uint32_t>, state_id_t, key_hash> states_;
+    // anchored and unanchored start states
+    std::array<state_id_t, 2> starts_{kUnknown, kUnknown};
+    size_t used_    = 0;
+    size_t flushes_ = 0;
+};
+
+} // namespace regexp::detail
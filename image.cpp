@@ -0,0 +1,90 @@
+#include "image.hpp"
+
+#include <array>
+#include <bit>
+#include <utility>
+
+namespace
+{
+
+using namespace regexp::detail;
+
+constexpr std::array<char, 8> kMagic = {'r', 'e', 'g', 'e', 'x', 'p', '\0', '\0'};
+constexpr uint32_t kVersion          = 1;
+constexpr uint32_t kByteOrder        = 0x01020304;
+
+struct header {
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t kind;
+    uint32_t byte_order;
+    uint32_t reserved;
+    // bytes following the header and their checksum
+    uint64_t size;
+    uint64_t checksum;
+};
+
+constexpr size_t kHeaderSize = (sizeof(header) + image_alignment - 1) & ~(image_alignment - 1);
+
+uint64_t checksum(std::string_view s) noexcept
+{
+    uint64_t h = 0x9e3779b97f4a7c15 ^ s.size();
+    size_t i   = 0;
+    for (; i + sizeof(uint64_t) <= s.size(); i += sizeof(uint64_t)) {
+        uint64_t w;
+        std::memcpy(&w, s.data() + i, sizeof(w));
+        h = std::rotl((h ^ w) * 0xff51afd7ed558ccd, 31);
+    }
+    for (; i < s.size(); ++i)
+        h = std::rotl((h ^ static_cast<unsigned char>(s[i])) * 0xff51afd7ed558ccd, 31);
+    return h ^ h >> 33;
+}
+
+} // namespace
+
+namespace regexp::detail
+{
+
+image_writer::image_writer(image_kind kind)
+    : out_(kHeaderSize, '\0')
+{
+    header const h{kMagic, kVersion, static_cast<uint32_t>(kind), kByteOrder, 0, 0, 0};
+    std::memcpy(out_.data(), &h, sizeof(h));
+}
+
+std::string image_writer::finish() &&
+{
+    header h;
+    std::memcpy(&h, out_.data(), sizeof(h));
+    h.size     = out_.size() - kHeaderSize;
+    h.checksum = checksum(std::string_view{out_}.substr(kHeaderSize));
+    std::memcpy(out_.data(), &h, sizeof(h));
+    return std::move(out_);
+}
+
+image_reader::image_reader(std::string_view image, image_kind kind)
+    : image_(image)
+    , pos_(kHeaderSize)
+{
+    header h;
+    if (image.size() < kHeaderSize)
+        throw std::invalid_argument("truncated pattern image");
+    std::memcpy(&h, image.data(), sizeof(h));
+
+    if (kMagic != h.magic)
+        throw std::invalid_argument("not a pattern image");
+    if (kByteOrder != h.byte_order)
+        throw std::invalid_argument("pattern image of another byte order");
+    if (kVersion != h.version)
+        throw std::invalid_argument("unsupported pattern image version");
+    if (static_cast<uint32_t>(kind) != h.kind)
+        throw std::invalid_argument("pattern image of another kind");
+    if (0 != reinterpret_cast<uintptr_t>(image.data()) % image_alignment)
+        throw std::invalid_argument("misaligned pattern image");
+    if (h.size != image.size() - kHeaderSize)
+        throw std::invalid_argument("truncated pattern image");
+    if (h.checksum != checksum(image.substr(kHeaderSize)))
+        throw std::invalid_argument("corrupted pattern image");
+}
+
+} // namespace regexp::detail
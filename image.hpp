@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace regexp::detail
+{
+
+enum class image_kind : uint32_t {
+    pattern     = 1,
+    pattern_set = 2,
+};
+
+/*
+ * Binary image of compiled patterns: a header followed by 64-bit values and
+ * arrays aligned to image_alignment bytes. Arrays are referred to by their
+ * position in the image only, so an image may be loaded at any address
+ * aligned as well, and its arrays are used in place. Values are stored in
+ * the byte order of the writer, images of another byte order are rejected.
+ */
+inline constexpr size_t image_alignment = 16;
+
+class image_writer
+{
+public:
+    explicit image_writer(image_kind kind);
+
+    void put(uint64_t v) { out_.append(reinterpret_cast<char const*>(&v), sizeof(v)); }
+
+    template <typename T>
+    void put_array(std::span<T const> items)
+    {
+        static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= image_alignment);
+        put(items.size());
+        align();
+        out_.append(reinterpret_cast<char const*>(items.data()), items.size_bytes());
+        align();
+    }
+
+    void put_string(std::string_view s) { put_array(std::span{s.data(), s.size()}); }
+
+    // the image with its header completed
+    std::string finish() &&;
+
+private:
+    void align() { out_.resize((out_.size() + image_alignment - 1) & ~(image_alignment - 1)); }
+
+    std::string out_;
+};
+
+/*
+ * Reads the values of an image in the order they were written. The header
+ * and the checksum are verified on construction, reading past the end
+ * throws std::invalid_argument.
+ */
+class image_reader
+{
+public:
+    image_reader(std::string_view image, image_kind kind);
+
+    uint64_t get()
+    {
+        uint64_t v;
+        std::memcpy(&v, take(sizeof(v)), sizeof(v));
+        return v;
+    }
+
+    template <typename T>
+    std::span<T const> get_array()
+    {
+        auto const size = get();
+        if (size > (image_.size() - pos_) / sizeof(T))
+            throw std::invalid_argument("truncated pattern image");
+        align();
+        auto const* items = reinterpret_cast<T const*>(take(size * sizeof(T)));
+        align();
+        return {items, size};
+    }
+
+    std::string_view get_string()
+    {
+        auto const s = get_array<char>();
+        return {s.data(), s.size()};
+    }
+
+    size_t remaining() const noexcept { return image_.size() - pos_; }
+    bool done() const noexcept { return pos_ == image_.size(); }
+
+private:
+    char const* take(size_t size)
+    {
+        if (size > image_.size() - pos_)
+            throw std::invalid_argument("truncated pattern image");
+        auto const* p = image_.data() + pos_;
+        pos_ += size;
+        return p;
+    }
+
+    void align() noexcept
+    {
+        pos_ = std::min((pos_ + image_alignment - 1) & ~(image_alignment - 1), image_.size());
+    }
+
+    std::string_view image_;
+    size_t pos_ = 0;
+};
+
+} // namespace regexp::detail
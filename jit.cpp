@@ -0,0 +1,455 @@
+#include "jit.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include <initializer_list>
+#include <limits>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+
+using namespace regexp::detail;
+
+#if defined(__x86_64__) && defined(__linux__)
+
+constexpr size_t kMaxRepetitions = 4096;
+
+enum reg : uint8_t { rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi, r8, r9, r10, r11 };
+
+enum cond : uint8_t { kBelow = 0x2, kAboveEqual = 0x3, kEqual = 0x4, kNotEqual = 0x5 };
+
+// just enough of an x86-64 assembler, all jumps and rip-relative operands take 32-bit offsets
+class assembler
+{
+public:
+    using label = size_t;
+
+    label new_label()
+    {
+        labels_.push_back(kUnbound);
+        return labels_.size() - 1;
+    }
+
+    void bind(label l) { labels_[l] = code_.size(); }
+
+    void mov(reg dst, reg src) { rr(0x89, src, dst); }
+    void add(reg dst, reg src) { rr(0x01, src, dst); }
+    void sub(reg dst, reg src) { rr(0x29, src, dst); }
+    void cmp(reg a, reg b) { rr(0x39, b, a); }
+
+    void cmova(reg dst, reg src)
+    {
+        rex(true, dst, src);
+        bytes({0x0f, 0x47, modrm(3, dst, src)});
+    }
+
+    void mov(reg dst, uint64_t imm)
+    {
+        rex(true, rax, dst);
+        byte(0xb8 + (dst & 7));
+        le(imm, 8);
+    }
+
+    void add(reg dst, int32_t imm) { ri(0, dst, imm); }
+    void cmp(reg a, int32_t imm) { ri(7, a, imm); }
+
+    void inc(reg r)
+    {
+        rex(true, rax, r);
+        bytes({0xff, modrm(3, rax, r)});
+    }
+
+    // cmp byte [base + disp], imm
+    void cmp_byte(reg base, int32_t disp, uint8_t imm)
+    {
+        rex(false, rax, base);
+        bytes({0x80, modrm(2, rdi, base)});
+        le(static_cast<uint32_t>(disp), 4);
+        byte(imm);
+    }
+
+    // cmp qword [base + disp], src
+    void cmp_qword(reg base, int32_t disp, reg src)
+    {
+        rex(true, src, base);
+        bytes({0x39, modrm(2, src, base)});
+        le(static_cast<uint32_t>(disp), 4);
+    }
+
+    // movzx dst, byte [base]
+    void movzx_byte(reg dst, reg base)
+    {
+        rex(false, dst, base);
+        bytes({0x0f, 0xb6, modrm(2, dst, base)});
+        le(0, 4);
+    }
+
+    // bt [rip + l], r
+    void bt(label l, reg r)
+    {
+        rex(true, r, rax);
+        bytes({0x0f, 0xa3, modrm(0, r, rbp)});
+        fixup(l);
+    }
+
+    // lea r, [rip + l]
+    void lea(reg r, label l)
+    {
+        rex(true, r, rax);
+        bytes({0x8d, modrm(0, r, rbp)});
+        fixup(l);
+    }
+
+    // mov dst, [rsp + disp], mov [rsp + disp], src and cmp r, [rsp + disp]
+    void load_top(reg dst, uint8_t disp) { top(0x8b, dst, disp); }
+    void store_top(uint8_t disp, reg src) { top(0x89, src, disp); }
+    void cmp_top(reg r, uint8_t disp) { top(0x3b, r, disp); }
+
+    void push(reg r)
+    {
+        if (r >= r8)
+            byte(0x41);
+        byte(0x50 + (r & 7));
+    }
+
+    void pop(reg r)
+    {
+        if (r >= r8)
+            byte(0x41);
+        byte(0x58 + (r & 7));
+    }
+
+    void jmp(reg r)
+    {
+        rex(false, rax, r);
+        bytes({0xff, modrm(3, rsp, r)});
+    }
+
+    void jmp(label l)
+    {
+        byte(0xe9);
+        fixup(l);
+    }
+
+    void j(cond c, label l)
+    {
+        bytes({0x0f, static_cast<uint8_t>(0x80 + c)});
+        fixup(l);
+    }
+
+    void ret() { byte(0xc3); }
+
+    void align(size_t n)
+    {
+        while (code_.size() % n)
+            byte(0xcc);
+    }
+
+    void data(void const* p, size_t n)
+    {
+        auto const* b = static_cast<uint8_t const*>(p);
+        code_.insert(code_.end(), b, b + n);
+    }
+
+    size_t size() const noexcept { return code_.size(); }
+
+    // resolves the label offsets into dst, which holds size() bytes
+    void link(uint8_t* dst) const
+    {
+        std::memcpy(dst, code_.data(), code_.size());
+        for (auto const& [at, l] : fixups_) {
+            auto const rel = static_cast<int64_t>(labels_[l]) - static_cast<int64_t>(at + 4);
+            auto const v   = static_cast<uint32_t>(static_cast<int32_t>(rel));
+            std::memcpy(dst + at, &v, 4);
+        }
+    }
+
+private:
+    static constexpr size_t kUnbound = std::numeric_limits<size_t>::max();
+
+    static uint8_t modrm(uint8_t mod, reg r, reg rm)
+    {
+        return static_cast<uint8_t>(mod << 6 | (r & 7) << 3 | (rm & 7));
+    }
+
+    void rex(bool w, reg r, reg rm)
+    {
+        uint8_t const v = 0x40 | w << 3 | (r >= r8) << 2 | (rm >= r8);
+        if (0x40 != v)
+            byte(v);
+    }
+
+    void rr(uint8_t op, reg r, reg rm)
+    {
+        rex(true, r, rm);
+        bytes({op, modrm(3, r, rm)});
+    }
+
+    void ri(uint8_t ext, reg rm, int32_t imm)
+    {
+        rex(true, rax, rm);
+        bytes({0x81, modrm(3, static_cast<reg>(ext), rm)});
+        le(static_cast<uint32_t>(imm), 4);
+    }
+
+    void top(uint8_t op, reg r, uint8_t disp)
+    {
+        rex(true, r, rsp);
+        bytes({op, modrm(1, r, rsp), 0x24, disp});
+    }
+
+    void fixup(label l)
+    {
+        fixups_.emplace_back(code_.size(), l);
+        le(0, 4);
+    }
+
+    void byte(uint8_t b) { code_.push_back(b); }
+
+    void bytes(std::initializer_list<uint8_t> bs) { code_.insert(code_.end(), bs); }
+
+    void le(uint64_t v, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i, v >>= 8)
+            byte(static_cast<uint8_t>(v));
+    }
+
+    std::vector<uint8_t> code_;
+    std::vector<size_t> labels_;
+    std::vector<std::pair<size_t, label>> fixups_;
+};
+
+constexpr bool fits_imm32(uint64_t v)
+{
+    return v <= static_cast<uint64_t>(std::numeric_limits<int32_t>::max());
+}
+
+/*
+ * rdi is the current input position and rsi the end of the input, rdx keeps
+ * the stack pointer of the entry. A repetition scans its longest run into
+ * r8, continues with its shortest run and pushes a frame of its next
+ * position, its longest run end and its retry address. A failure pops the
+ * latest frame and jumps to its retry code, or returns 0 when none is left.
+ */
+void assemble(assembler& as, program const& prog)
+{
+    auto const& code = prog.code();
+
+    std::vector<assembler::label> starts(code.size());
+    for (auto& l : starts)
+        l = as.new_label();
+    auto const fail    = as.new_label();
+    auto const success = as.new_label();
+
+    std::vector<std::pair<assembler::label, charset>> bitmaps;
+
+    as.mov(rdx, rsp);
+
+    size_t repetitions = 0;
+    for (size_t pc = 0; pc < code.size(); ++pc) {
+        auto const& in = code[pc];
+        as.bind(starts[pc]);
+
+        switch (in.op) {
+            case opcode::literal:
+            case opcode::wildcard_literal: {
+                auto const literal = prog.literal(in);
+                if (!fits_imm32(literal.size()))
+                    throw std::invalid_argument("literal is too long for the jit");
+
+                as.mov(rax, rsi);
+                as.sub(rax, rdi);
+                as.cmp(rax, static_cast<int32_t>(literal.size()));
+                as.j(kBelow, fail);
+
+                size_t i = 0;
+                for (; i + 8 <= literal.size() &&
+                       std::string_view::npos == literal.substr(i, 8).find('.');
+                     i += 8) {
+                    uint64_t v;
+                    std::memcpy(&v, literal.data() + i, 8);
+                    as.mov(rcx, v);
+                    as.cmp_qword(rdi, static_cast<int32_t>(i), rcx);
+                    as.j(kNotEqual, fail);
+                }
+                for (; i < literal.size(); ++i) {
+                    if (opcode::wildcard_literal == in.op && '.' == literal[i])
+                        continue;
+                    as.cmp_byte(rdi, static_cast<int32_t>(i), static_cast<uint8_t>(literal[i]));
+                    as.j(kNotEqual, fail);
+                }
+
+                as.add(rdi, static_cast<int32_t>(literal.size()));
+            } break;
+            case opcode::match:
+                as.cmp(rdi, rsi);
+                as.j(kNotEqual, fail);
+                as.jmp(success);
+                break;
+            default: {
+                if (++repetitions > kMaxRepetitions)
+                    throw std::invalid_argument("pattern has too many repetitions for the jit");
+
+                // r9 = rdi + min(n, rsi - rdi)
+                as.mov(r9, rsi);
+                as.sub(r9, rdi);
+                if (std::numeric_limits<uint32_t>::max() != in.n) {
+                    as.mov(rax, uint64_t{in.n});
+                    as.cmp(r9, rax);
+                    as.cmova(r9, rax);
+                }
+                as.add(r9, rdi);
+
+                if (opcode::any_char == in.op) {
+                    as.mov(r8, r9);
+                } else {
+                    auto const loop = as.new_label();
+                    auto const done = as.new_label();
+                    as.mov(r8, rdi);
+                    as.bind(loop);
+                    as.cmp(r8, r9);
+                    as.j(kAboveEqual, done);
+                    if (opcode::spec_char == in.op) {
+                        as.cmp_byte(r8, 0, static_cast<uint8_t>(in.c));
+                        as.j(kNotEqual, done);
+                    } else {
+                        bitmaps.emplace_back(as.new_label(), prog.one_of(in).cs);
+                        as.movzx_byte(rax, r8);
+                        as.bt(bitmaps.back().first, rax);
+                        as.j(kAboveEqual, done);
+                    }
+                    as.inc(r8);
+                    as.jmp(loop);
+                    as.bind(done);
+                }
+
+                if (in.m) {
+                    as.mov(rax, r8);
+                    as.sub(rax, rdi);
+                    as.mov(rcx, uint64_t{in.m});
+                    as.cmp(rax, rcx);
+                    as.j(kBelow, fail);
+                }
+
+                // the last repetition has to consume the rest of the input
+                if (opcode::match == code[pc + 1].op) {
+                    as.cmp(r8, rsi);
+                    as.j(kNotEqual, fail);
+                    as.jmp(success);
+                    break;
+                }
+
+                auto const retry = as.new_label();
+                auto const drop  = as.new_label();
+                if (in.m) {
+                    as.mov(rax, uint64_t{in.m});
+                    as.add(rdi, rax);
+                }
+                as.push(r8);
+                as.push(rdi);
+                as.lea(rax, retry);
+                as.push(rax);
+                as.jmp(starts[pc + 1]);
+
+                as.bind(retry);
+                as.load_top(rdi, 0);
+                as.cmp_top(rdi, 8);
+                as.j(kAboveEqual, drop);
+                as.inc(rdi);
+                as.store_top(0, rdi);
+                as.lea(rax, retry);
+                as.push(rax);
+                as.jmp(starts[pc + 1]);
+
+                as.bind(drop);
+                as.add(rsp, 16);
+                as.jmp(fail);
+            } break;
+        }
+    }
+
+    auto const none = as.new_label();
+    as.bind(fail);
+    as.cmp(rsp, rdx);
+    as.j(kEqual, none);
+    as.pop(rax);
+    as.jmp(rax);
+
+    // 31 c0: xor eax, eax
+    as.bind(none);
+    as.data("\x31\xc0", 2);
+    as.ret();
+
+    // b8 01 00 00 00: mov eax, 1
+    as.bind(success);
+    as.mov(rsp, rdx);
+    as.data("\xb8\x01\x00\x00\x00", 5);
+    as.ret();
+
+    as.align(32);
+    for (auto const& [l, cs] : bitmaps) {
+        as.bind(l);
+        as.data(cs.bits.data(), sizeof(cs.bits));
+    }
+}
+
+#endif
+
+} // namespace
+
+namespace regexp::detail
+{
+
+#if defined(__x86_64__) && defined(__linux__)
+
+jit::jit(program const& prog)
+{
+    assembler as;
+    assemble(as, prog);
+    if (as.size() > max_code_size)
+        throw std::invalid_argument("pattern is too large for the jit");
+
+    auto* const addr =
+        ::mmap(nullptr, as.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == addr)
+        throw std::system_error(errno, std::generic_category(), "mmap");
+
+    as.link(static_cast<uint8_t*>(addr));
+    if (0 != ::mprotect(addr, as.size(), PROT_READ | PROT_EXEC)) {
+        auto const err = errno;
+        ::munmap(addr, as.size());
+        throw std::system_error(err, std::generic_category(), "mprotect");
+    }
+
+    code_  = addr;
+    size_  = as.size();
+    entry_ = reinterpret_cast<entry_t>(addr);
+}
+
+jit::~jit()
+{
+    ::munmap(code_, size_);
+}
+
+#else
+
+jit::jit(program const&)
+{
+    throw std::invalid_argument("the jit is not supported on this platform");
+}
+
+jit::~jit() = default;
+
+#endif
+
+} // namespace regexp::detail
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+
+#include <string_view>
+
+#include "program.hpp"
+
+namespace regexp::detail
+{
+
+/*
+ * Native x86-64 code of a program running the same search as the
+ * backtracker: literals become immediate compares, classes bit tests
+ * against a bitmap stored next to the code and repetitions tight scanning
+ * loops. Every repetition keeps a single frame with its next run length on
+ * the machine stack, so the stack depth is bounded by the program size.
+ * Throws std::invalid_argument when the program or the platform is not
+ * supported, and std::system_error when executable memory is unavailable.
+ */
+class jit
+{
+public:
+    static constexpr size_t max_code_size = 1 << 20;
+
+    explicit jit(program const& prog);
+    jit(jit const&)            = delete;
+    jit& operator=(jit const&) = delete;
+    ~jit();
+
+    bool match(std::string_view s) const noexcept
+    {
+        return 0 != entry_(s.data(), s.data() + s.size());
+    }
+
+    size_t code_size() const noexcept { return size_; }
+
+private:
+    using entry_t = int (*)(char const* first, char const* last);
+
+    void* code_   = nullptr;
+    size_t size_  = 0;
+    entry_t entry_ = nullptr;
+};
+
+} // namespace regexp::detail
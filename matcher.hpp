@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <bit>
+#include <functional>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+namespace regexp::detail
+{
+
+// 256-bit membership bitmap of a character class, a lookup is a single load
+struct charset {
+    constexpr charset() noexcept = default;
+
+    constexpr explicit charset(std::string_view cs) noexcept
+    {
+        for (auto const c : cs)
+            set(c);
+    }
+
+    constexpr void set(char c) noexcept
+    {
+        auto const b = static_cast<unsigned char>(c);
+        bits[b >> 6] |= uint64_t{1} << (b & 63);
+    }
+
+    constexpr bool test(char c) const noexcept
+    {
+        auto const b = static_cast<unsigned char>(c);
+        return bits[b >> 6] >> (b & 63) & 1;
+    }
+
+    constexpr size_t count() const noexcept
+    {
+        size_t qty = 0;
+        for (auto const w : bits)
+            qty += std::popcount(w);
+        return qty;
+    }
+
+    constexpr charset operator~() const noexcept
+    {
+        charset r;
+        for (size_t i = 0; i < bits.size(); ++i)
+            r.bits[i] = ~bits[i];
+        return r;
+    }
+
+    constexpr bool operator==(charset const&) const noexcept = default;
+
+    static constexpr charset all() noexcept { return ~charset{}; }
+
+    std::array<uint64_t, 4> bits{};
+};
+
+struct charset_hash {
+    size_t operator()(charset const& cs) const noexcept
+    {
+        size_t h = 0;
+        for (auto const w : cs.bits)
+            h = h * 31 + std::hash<uint64_t>{}(w);
+        return h;
+    }
+};
+
+template <typename Range>
+struct matcher_range {
+    Range cs;
+};
+
+struct min_max_rule {
+    uint32_t m, n;
+};
+
+struct matcher_range_strict : matcher_range<std::string_view> {
+};
+
+struct matcher_spec_char : min_max_rule {
+    char c;
+};
+
+struct matcher_any_char : min_max_rule {
+};
+
+struct matcher_range_one_of_char : matcher_range<charset>, min_max_rule {
+};
+
+struct matcher_range_one_of_char_positive : matcher_range_one_of_char {
+};
+
+struct matcher_range_one_of_char_negative : matcher_range_one_of_char {
+};
+
+/* clang-format off */
+using matcher_t = std::variant<
+  matcher_range_strict,
+  matcher_spec_char,
+  matcher_any_char,
+  matcher_range_one_of_char_positive,
+  matcher_range_one_of_char_negative
+>;
+/* clang-format on */
+
+using matcher_table_t = std::vector<matcher_t>;
+
+template <typename... Args>
+constexpr bool dependent_false_v = false;
+
+matcher_table_t convert_to_table(std::string_view p);
+
+} // namespace regexp::detail
@@ -0,0 +1,188 @@
+#include "nfa.hpp"
+
+#include <cstdint>
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+namespace
+{
+
+using namespace regexp::detail;
+
+nfa::buffers& prepare(nfa::buffers& b, size_t states)
+{
+    b.clist.reserve(states);
+    b.nlist.reserve(states);
+    if (b.cstarts.size() < states) {
+        b.cstarts.resize(states);
+        b.nstarts.resize(states);
+    }
+    b.clist.clear();
+    b.nlist.clear();
+    return b;
+}
+
+} // namespace
+
+namespace regexp::detail
+{
+
+nfa::nfa(program const& prog)
+{
+    append_positions(prog, positions_);
+}
+
+void nfa::append_positions(program const& prog, std::vector<position>& positions)
+{
+    auto const base    = positions.size();
+    auto const reserve = [&](uint64_t qty) {
+        if (positions.size() - base + qty > max_positions)
+            throw std::invalid_argument("pattern is too large for the nfa engine");
+        positions.reserve(positions.size() + qty);
+    };
+
+    for (auto const& in : prog.code()) {
+        switch (in.op) {
+            case opcode::literal:
+            case opcode::wildcard_literal:
+                reserve(in.m);
+                for (auto const c : prog.literal(in)) {
+                    charset cs;
+                    if (opcode::wildcard_literal == in.op && '.' == c)
+                        cs = charset::all();
+                    else
+                        cs.set(c);
+                    positions.push_back({cs, false, false});
+                }
+                continue;
+            case opcode::match:
+                continue;
+            default:
+                break;
+        }
+
+        auto const cs = prog.accepted(in);
+        if (std::numeric_limits<uint32_t>::max() == in.n) {
+            reserve(std::max<uint64_t>(in.m, 1));
+            for (uint32_t k = 1; k < in.m; ++k)
+                positions.push_back({cs, false, false});
+            positions.push_back({cs, 0 == in.m, true});
+        } else {
+            reserve(in.n);
+            for (uint32_t k = 0; k < in.n; ++k)
+                positions.push_back({cs, k >= in.m, false});
+        }
+    }
+}
+
+void nfa::add_closure(sparse_set& states, uint32_t b) const noexcept
+{
+    for (; states.insert(b) && b < positions_.size() && positions_[b].optional; ++b)
+        ;
+}
+
+void nfa::step(sparse_set const& from, sparse_set& to, unsigned char c) const noexcept
+{
+    to.clear();
+    for (auto const b : from) {
+        if (b < positions_.size() && positions_[b].cs.test(static_cast<char>(c))) {
+            if (positions_[b].loop)
+                add_closure(to, b);
+            add_closure(to, b + 1);
+        }
+    }
+}
+
+void nfa::add_closure(
+    sparse_set& states,
+    std::vector<size_t>& starts,
+    uint32_t b,
+    size_t start) const noexcept
+{
+    for (; states.insert(b); ++b) {
+        starts[b] = start;
+        if (b == positions_.size() || !positions_[b].optional)
+            break;
+    }
+}
+
+bool nfa::match(std::string_view s, buffers& buf) const
+{
+    auto& [clist, nlist, cstarts, nstarts] = prepare(buf, positions_.size() + 1);
+
+    add_closure(clist, 0);
+    for (auto const c : s) {
+        step(clist, nlist, static_cast<unsigned char>(c));
+        if (nlist.empty())
+            return false;
+        std::swap(clist, nlist);
+    }
+
+    return clist.contains(accepting());
+}
+
+bool nfa::search(std::string_view s, buffers& buf) const
+{
+    auto& [clist, nlist, cstarts, nstarts] = prepare(buf, positions_.size() + 1);
+
+    add_closure(clist, 0);
+    for (auto const c : s) {
+        if (clist.contains(accepting()))
+            return true;
+        step(clist, nlist, static_cast<unsigned char>(c));
+        add_closure(nlist, 0);
+        std::swap(clist, nlist);
+    }
+
+    return clist.contains(accepting());
+}
+
+/*
+ * Every thread remembers where its match started. Threads are kept ordered
+ * by their start offsets, so the first one to reach a state is the leftmost
+ * one, and once a match is found threads starting later are dropped while
+ * the others keep running to extend it.
+ */
+std::optional<std::pair<size_t, size_t>> nfa::find(std::string_view s, buffers& buf) const
+{
+    auto& [clist, nlist, cstarts, nstarts] = prepare(buf, positions_.size() + 1);
+
+    std::optional<std::pair<size_t, size_t>> best;
+    for (size_t i = 0;; ++i) {
+        if (!best)
+            add_closure(clist, cstarts, 0, i);
+        else if (clist.empty())
+            break;
+
+        if (clist.contains(accepting())) {
+            auto const first = cstarts[accepting()];
+            if (!best || first < best->first || first == best->first && i > best->second)
+                best.emplace(first, i);
+        }
+
+        if (s.size() == i)
+            break;
+
+        auto const c = s[i];
+        nlist.clear();
+        for (auto const b : clist) {
+            if (best && cstarts[b] > best->first)
+                break;
+            if (b < positions_.size() && positions_[b].cs.test(c)) {
+                if (positions_[b].loop)
+                    add_closure(nlist, nstarts, b, cstarts[b]);
+                add_closure(nlist, nstarts, b + 1, cstarts[b]);
+            }
+        }
+        std::swap(clist, nlist);
+        std::swap(cstarts, nstarts);
+    }
+
+    return best;
+}
+
+} // namespace regexp::detail
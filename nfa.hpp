@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "matcher.hpp"
+#include "program.hpp"
+
+namespace regexp::detail
+{
+
+class sparse_set
+{
+public:
+    explicit sparse_set(size_t capacity = 0)
+        : dense_(capacity)
+        , sparse_(capacity)
+    {
+    }
+
+    size_t capacity() const noexcept { return dense_.size(); }
+
+    void reserve(size_t capacity)
+    {
+        if (capacity > dense_.size()) {
+            dense_.resize(capacity);
+            sparse_.resize(capacity);
+        }
+    }
+
+    bool contains(uint32_t v) const noexcept
+    {
+        auto const i = sparse_[v];
+        return i < size_ && dense_[i] == v;
+    }
+
+    bool insert(uint32_t v) noexcept
+    {
+        if (contains(v))
+            return false;
+        sparse_[v]       = size_;
+        dense_[size_++] = v;
+        return true;
+    }
+
+    void clear() noexcept { size_ = 0; }
+
+    bool empty() const noexcept { return 0 == size_; }
+    uint32_t size() const noexcept { return size_; }
+
+    auto begin() const noexcept { return dense_.cbegin(); }
+    auto end() const noexcept { return dense_.cbegin() + size_; }
+
+private:
+    std::vector<uint32_t> dense_;
+    std::vector<uint32_t> sparse_;
+    uint32_t size_ = 0;
+};
+
+/*
+ * Position automaton built from a program. Every character the
+ * pattern may consume becomes a position; counted repetitions are expanded
+ * into mandatory and optional positions and unbounded ones loop on their
+ * last position. A state is the boundary index in front of a position, the
+ * boundary past the last position is the accepting one.
+ */
+class nfa
+{
+public:
+    static constexpr size_t max_positions = 1 << 14;
+
+    struct position {
+        charset cs;
+        bool optional;
+        bool loop;
+    };
+
+    // simulation buffers, grown to the automata they are used with and kept between runs
+    struct buffers {
+        sparse_set clist;
+        sparse_set nlist;
+        std::vector<size_t> cstarts;
+        std::vector<size_t> nstarts;
+    };
+
+    explicit nfa(program const& prog);
+    explicit nfa(std::vector<position> positions) noexcept
+        : positions_(std::move(positions))
+    {
+    }
+
+    // expands a program into positions appended to the given ones
+    static void append_positions(program const& prog, std::vector<position>& positions);
+
+    bool match(std::string_view s, buffers& buf) const;
+    bool search(std::string_view s, buffers& buf) const;
+    // leftmost-longest match as offsets [first, last) into s
+    std::optional<std::pair<size_t, size_t>> find(std::string_view s, buffers& buf) const;
+
+    std::vector<position> const& positions() const noexcept { return positions_; }
+    uint32_t accepting() const noexcept { return static_cast<uint32_t>(positions_.size()); }
+
+    void add_closure(sparse_set& states, uint32_t b) const noexcept;
+    void step(sparse_set const& from, sparse_set& to, unsigned char c) const noexcept;
+
+private:
+    void add_closure(
+        sparse_set& states,
+        std::vector<size_t>& starts,
+        uint32_t b,
+        size_t start) const noexcept;
+
+    std::vector<position> positions_;
+};
+
+} // namespace regexp::detail
@@ -0,0 +1,196 @@
+#include "optimizer.hpp"
+
+#include <cstdint>
+
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace
+{
+
+using namespace regexp::detail;
+
+constexpr auto kInf = std::numeric_limits<uint32_t>::max();
+
+// longest fixed repetition of a character spelled out in a merged literal
+constexpr uint32_t kMaxUnrolled = 16;
+
+template <typename Matcher>
+auto* repetition(Matcher& matcher) noexcept
+{
+    using rule = std::conditional_t<std::is_const_v<Matcher>, min_max_rule const, min_max_rule>;
+    return std::visit(
+        [](auto& m) -> rule* {
+            if constexpr (std::is_base_of_v<min_max_rule, std::decay_t<decltype(m)>>)
+                return &m;
+            else
+                return nullptr;
+        },
+        matcher);
+}
+
+std::optional<char> single_character(charset const& cs) noexcept
+{
+    if (1 != cs.count())
+        return std::nullopt;
+
+    int c = 0;
+    while (!cs.test(static_cast<char>(c)))
+        ++c;
+    return static_cast<char>(c);
+}
+
+// an unbounded wildcard matches whatever a repetition allowed to match nothing does next to it
+bool absorbs(matcher_t const& wildcard, matcher_t const& matcher) noexcept
+{
+    auto const* any  = std::get_if<matcher_any_char>(&wildcard);
+    auto const* rule = repetition(matcher);
+    return any && kInf == any->n && rule && 0 == rule->m;
+}
+
+bool repeats_same_characters(matcher_t const& a, matcher_t const& b) noexcept
+{
+    if (a.index() != b.index())
+        return false;
+
+    return std::visit(
+        [&](auto const& x) {
+            using type    = std::decay_t<decltype(x)>;
+            auto const& y = std::get<type>(b);
+            if constexpr (std::is_same_v<type, matcher_range_strict>)
+                return false;
+            else if constexpr (std::is_same_v<type, matcher_spec_char>)
+                return x.c == y.c;
+            else if constexpr (std::is_same_v<type, matcher_any_char>)
+                return true;
+            else
+                return x.cs == y.cs;
+        },
+        a);
+}
+
+// a repetition of a then of b as a single one, none when the counts do not fit
+std::optional<min_max_rule> concatenate(min_max_rule const& a, min_max_rule const& b) noexcept
+{
+    auto const unbounded = kInf == a.n || kInf == b.n;
+    if (uint64_t{a.m} + b.m >= kInf || !unbounded && uint64_t{a.n} + b.n >= kInf)
+        return std::nullopt;
+    return min_max_rule{a.m + b.m, unbounded ? kInf : a.n + b.n};
+}
+
+bool is_literal(matcher_t const& matcher) noexcept
+{
+    if (std::holds_alternative<matcher_range_strict>(matcher))
+        return true;
+
+    // '.' is a wildcard inside literals
+    auto const* spec = std::get_if<matcher_spec_char>(&matcher);
+    return spec && spec->m == spec->n && 0 < spec->n && spec->n <= kMaxUnrolled && '.' != spec->c;
+}
+
+void append_literal(std::string& s, matcher_t const& matcher)
+{
+    if (auto const* strict = std::get_if<matcher_range_strict>(&matcher))
+        s.append(strict->cs);
+    else if (auto const* spec = std::get_if<matcher_spec_char>(&matcher))
+        s.append(spec->n, spec->c);
+}
+
+} // namespace
+
+namespace regexp::detail
+{
+
+optimized_table optimize(matcher_table_t table)
+{
+    optimized_table result;
+    auto& counts = result.rewrites;
+
+    matcher_table_t folded;
+    folded.reserve(table.size());
+    for (auto matcher : table) {
+        if (auto const* one_of = std::get_if<matcher_range_one_of_char_positive>(&matcher)) {
+            if (auto const c = single_character(one_of->cs)) {
+                matcher = matcher_spec_char{{one_of->m, one_of->n}, *c};
+                ++counts.folded_classes;
+            }
+        } else if (auto const* one_of = std::get_if<matcher_range_one_of_char_negative>(&matcher)) {
+            if (auto const c = single_character(~one_of->cs)) {
+                matcher = matcher_spec_char{{one_of->m, one_of->n}, *c};
+                ++counts.folded_classes;
+            }
+        }
+
+        if (auto const* rule = repetition(matcher); rule && 0 == rule->n) {
+            ++counts.dropped_repeats;
+            continue;
+        }
+
+        auto keep = true;
+        while (keep && !folded.empty()) {
+            auto const& back = folded.back();
+            if (absorbs(back, matcher)) {
+                ++counts.dropped_repeats;
+                keep = false;
+            } else if (absorbs(matcher, back)) {
+                ++counts.dropped_repeats;
+                folded.pop_back();
+            } else if (!repeats_same_characters(back, matcher)) {
+                break;
+            } else if (auto const rule = concatenate(*repetition(back), *repetition(matcher))) {
+                *repetition(matcher) = *rule;
+                ++counts.merged_runs;
+                folded.pop_back();
+            } else {
+                break;
+            }
+        }
+        if (keep)
+            folded.push_back(std::move(matcher));
+    }
+
+    result.table.reserve(folded.size());
+    for (auto first = folded.cbegin(); first != folded.cend();) {
+        auto last = first;
+        while (last != folded.cend() && is_literal(*last))
+            ++last;
+
+        if (last - first < 2) {
+            result.table.push_back(*first++);
+            continue;
+        }
+
+        counts.merged_literals += last - first - 1;
+        auto& literal = result.literals.emplace_back();
+        for (; first != last; ++first)
+            append_literal(literal, *first);
+        result.table.push_back(matcher_range_strict{{literal}});
+    }
+
+    return result;
+}
+
+length_bounds match_length_bounds(matcher_table_t const& table) noexcept
+{
+    length_bounds bounds{0, 0};
+    for (auto const& matcher : table) {
+        size_t m, n;
+        if (auto const* rule = repetition(matcher)) {
+            m = rule->m;
+            n = kInf == rule->n ? length_bounds::unbounded : rule->n;
+        } else {
+            m = n = std::get<matcher_range_strict>(matcher).cs.size();
+        }
+
+        bounds.min += m;
+        if (length_bounds::unbounded == n || length_bounds::unbounded == bounds.max)
+            bounds.max = length_bounds::unbounded;
+        else
+            bounds.max += n;
+    }
+    return bounds;
+}
+
+} // namespace regexp::detail
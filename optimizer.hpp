@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+
+#include <deque>
+#include <limits>
+#include <string>
+
+#include "matcher.hpp"
+
+namespace regexp::detail
+{
+
+struct rewrite_counts {
+    // matchers merged into a neighbouring literal
+    size_t merged_literals = 0;
+    // repetitions of the same characters merged into one
+    size_t merged_runs = 0;
+    // classes of a single character turned into a repeated character
+    size_t folded_classes = 0;
+    // repetitions matching nothing or absorbed by an unbounded wildcard
+    size_t dropped_repeats = 0;
+};
+
+// lengths of the inputs a table may match in full
+struct length_bounds {
+    static constexpr size_t unbounded = std::numeric_limits<size_t>::max();
+
+    size_t min = 0;
+    size_t max = unbounded;
+
+    bool contains(size_t size) const noexcept { return min <= size && size <= max; }
+};
+
+/*
+ * A table rewritten into an equivalent one with fewer matchers. Merged
+ * literals no longer point into the pattern and are kept in literals, whose
+ * elements never move.
+ */
+struct optimized_table {
+    matcher_table_t table;
+    std::deque<std::string> literals;
+    rewrite_counts rewrites;
+};
+
+optimized_table optimize(matcher_table_t table);
+
+length_bounds match_length_bounds(matcher_table_t const& table) noexcept;
+
+} // namespace regexp::detail
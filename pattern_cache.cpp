@@ -0,0 +1,180 @@
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+#include "pattern_cache.hpp"
+#include "regexplib.hpp"
+
+namespace
+{
+
+constexpr size_t kShards           = 16;
+constexpr size_t kMinShardCapacity = 16;
+constexpr size_t kDefaultCapacity  = 256;
+
+/*
+ * Recently used patterns by their text. Each shard is an LRU list with its
+ * own lock and its own share of the capacity, so threads looking up
+ * different patterns rarely contend. Small caches use fewer shards, every
+ * shard in use holds at least kMinShardCapacity patterns unless the whole
+ * cache is smaller, which is then a single exact LRU list. Patterns are
+ * compiled outside of the lock.
+ */
+class pattern_cache
+{
+public:
+    static pattern_cache& instance()
+    {
+        static pattern_cache cache;
+        return cache;
+    }
+
+    regexp::pattern get(std::string_view p)
+    {
+        auto const h = std::hash<std::string_view>{}(p);
+        {
+            auto const [sh, lock] = lock_shard(h);
+            if (auto const it = sh.index.find(p); sh.index.end() != it) {
+                sh.lru.splice(sh.lru.begin(), sh.lru, it->second);
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                return it->second->second;
+            }
+        }
+
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        regexp::pattern compiled{p};
+
+        auto const [sh, lock] = lock_shard(h);
+        if (0 == sh.capacity)
+            return compiled;
+        // another thread may have compiled the same pattern meanwhile
+        if (auto const it = sh.index.find(p); sh.index.end() != it)
+            return it->second->second;
+
+        sh.lru.emplace_front(std::string{p}, compiled);
+        sh.index.emplace(sh.lru.front().first, sh.lru.begin());
+        evict(sh);
+        return compiled;
+    }
+
+    void set_capacity(size_t capacity)
+    {
+        std::array<std::unique_lock<std::mutex>, kShards> locks;
+        for (size_t i = 0; i < kShards; ++i)
+            locks[i] = std::unique_lock{shards_[i].mutex};
+
+        auto const used = std::clamp(capacity / kMinShardCapacity, size_t{1}, kShards);
+        if (used != used_.load(std::memory_order_relaxed)) {
+            // the patterns move to the shards their hashes pick among the new ones
+            decltype(shard::lru) all;
+            for (auto& sh : shards_) {
+                all.splice(all.end(), sh.lru);
+                sh.index.clear();
+            }
+            while (!all.empty()) {
+                auto& sh = shards_[std::hash<std::string_view>{}(all.front().first) % used];
+                sh.lru.splice(sh.lru.end(), all, all.begin());
+                sh.index.emplace(sh.lru.back().first, std::prev(sh.lru.end()));
+            }
+            used_.store(used, std::memory_order_relaxed);
+        }
+
+        capacity_.store(capacity, std::memory_order_relaxed);
+        for (size_t i = 0; i < kShards; ++i) {
+            shards_[i].capacity = i < used ? capacity / used + (i < capacity % used) : 0;
+            evict(shards_[i]);
+        }
+    }
+
+    regexp::cache_stats stats()
+    {
+        size_t size = 0;
+        for (auto& sh : shards_) {
+            std::lock_guard lock{sh.mutex};
+            size += sh.index.size();
+        }
+        return {
+            hits_.load(std::memory_order_relaxed),
+            misses_.load(std::memory_order_relaxed),
+            evictions_.load(std::memory_order_relaxed),
+            size,
+            capacity_.load(std::memory_order_relaxed),
+        };
+    }
+
+private:
+    struct shard {
+        std::mutex mutex;
+        size_t capacity = 0;
+        // most recently used first, the index keys view the strings of the list
+        std::list<std::pair<std::string, regexp::pattern>> lru;
+        std::unordered_map<std::string_view, decltype(lru)::iterator> index;
+    };
+
+    pattern_cache() { set_capacity(kDefaultCapacity); }
+
+    // the shards in use only change with all of them locked, a lookup racing with it retries
+    std::pair<shard&, std::unique_lock<std::mutex>> lock_shard(size_t h)
+    {
+        for (;;) {
+            auto const used = used_.load(std::memory_order_relaxed);
+            auto& sh        = shards_[h % used];
+            std::unique_lock lock{sh.mutex};
+            if (used == used_.load(std::memory_order_relaxed))
+                return {sh, std::move(lock)};
+        }
+    }
+
+    void evict(shard& sh)
+    {
+        for (; sh.index.size() > sh.capacity; sh.lru.pop_back()) {
+            sh.index.erase(sh.lru.back().first);
+            evictions_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    std::array<shard, kShards> shards_;
+    std::atomic<size_t> used_{kShards};
+    std::atomic<size_t> capacity_{0};
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> evictions_{0};
+};
+
+} // namespace
+
+namespace regexp
+{
+
+namespace detail
+{
+
+pattern cached_pattern(std::string_view p)
+{
+    return pattern_cache::instance().get(p);
+}
+
+} // namespace detail
+
+cache_stats pattern_cache_stats()
+{
+    return pattern_cache::instance().stats();
+}
+
+void set_pattern_cache_capacity(std::size_t capacity)
+{
+    pattern_cache::instance().set_capacity(capacity);
+}
+
+} // namespace regexp
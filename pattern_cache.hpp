@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string_view>
+
+#include "regexplib.hpp"
+
+namespace regexp::detail
+{
+
+// p compiled with the default options, taken from the process-wide cache or compiled and cached
+pattern cached_pattern(std::string_view p);
+
+} // namespace regexp::detail
@@ -0,0 +1,394 @@
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "image.hpp"
+#include "matcher.hpp"
+#include "nfa.hpp"
+#include "optimizer.hpp"
+#include "prefilter.hpp"
+#include "program.hpp"
+#include "regexplib.hpp"
+#include "scratch.hpp"
+
+namespace
+{
+
+using namespace regexp::detail;
+
+constexpr uint32_t kNone = std::numeric_limits<uint32_t>::max();
+
+// Aho-Corasick automaton over the required literals of the patterns
+class literal_automaton
+{
+public:
+    void add(std::string_view literal, uint32_t id)
+    {
+        uint32_t n = 0;
+        for (auto const c : literal) {
+            auto next = child(n, static_cast<uint8_t>(c));
+            if (kNone == next) {
+                next = static_cast<uint32_t>(nodes_.size());
+                nodes_[n].next.emplace_back(static_cast<uint8_t>(c), next);
+                nodes_.emplace_back();
+            }
+            n = next;
+        }
+        nodes_[n].ids.push_back(id);
+    }
+
+    void build()
+    {
+        std::vector<uint32_t> queue;
+        for (auto const& [c, v] : nodes_[0].next) {
+            root_[c] = v;
+            queue.push_back(v);
+        }
+
+        for (size_t i = 0; i < queue.size(); ++i) {
+            auto const u = queue[i];
+            for (auto const& [c, v] : nodes_[u].next) {
+                nodes_[v].fail = advance(nodes_[u].fail, c);
+                nodes_[v].out  = nodes_[nodes_[v].fail].ids.empty() ? nodes_[nodes_[v].fail].out
+                                                                    : nodes_[v].fail;
+                queue.push_back(v);
+            }
+        }
+    }
+
+    size_t size() const noexcept { return nodes_.size(); }
+
+    // reports every literal occurring in s once, stamps mark the nodes already reported
+    void scan(
+        std::string_view s,
+        std::vector<uint32_t>& stamps,
+        uint32_t stamp,
+        auto&& report) const
+    {
+        uint32_t n = 0;
+        for (auto const c : s) {
+            n = advance(n, static_cast<uint8_t>(c));
+            auto o = nodes_[n].ids.empty() ? nodes_[n].out : n;
+            for (; kNone != o && stamp != stamps[o]; o = nodes_[o].out) {
+                stamps[o] = stamp;
+                for (auto const id : nodes_[o].ids)
+                    report(id);
+            }
+        }
+    }
+
+private:
+    struct node {
+        std::vector<std::pair<uint8_t, uint32_t>> next;
+        uint32_t fail = 0;
+        // nearest node on the failure chain completing a literal
+        uint32_t out = kNone;
+        std::vector<uint32_t> ids;
+    };
+
+    uint32_t child(uint32_t n, uint8_t c) const noexcept
+    {
+        for (auto const& [nc, v] : nodes_[n].next) {
+            if (nc == c)
+                return v;
+        }
+        return kNone;
+    }
+
+    uint32_t advance(uint32_t n, uint8_t c) const noexcept
+    {
+        for (;; n = nodes_[n].fail) {
+            if (0 == n)
+                return root_[c];
+            if (auto const v = child(n, c); kNone != v)
+                return v;
+        }
+    }
+
+    std::vector<node> nodes_{1};
+    std::array<uint32_t, 256> root_{};
+};
+
+struct set_scratch {
+    sparse_set clist;
+    sparse_set nlist;
+    std::vector<uint32_t> node_stamps;
+    std::vector<uint32_t> pattern_stamps;
+    std::vector<uint32_t> candidates;
+    uint32_t stamp = 0;
+};
+
+set_scratch& prepare(set_scratch& sc, size_t states, size_t nodes, size_t patterns)
+{
+    sc.clist.reserve(states);
+    sc.nlist.reserve(states);
+    sc.clist.clear();
+    sc.nlist.clear();
+    sc.candidates.clear();
+    if (sc.node_stamps.size() < nodes)
+        sc.node_stamps.resize(nodes);
+    if (sc.pattern_stamps.size() < patterns)
+        sc.pattern_stamps.resize(patterns);
+    if (0 == ++sc.stamp) {
+        std::fill(sc.node_stamps.begin(), sc.node_stamps.end(), 0);
+        std::fill(sc.pattern_stamps.begin(), sc.pattern_stamps.end(), 0);
+        sc.stamp = 1;
+    }
+    return sc;
+}
+
+} // namespace
+
+namespace regexp
+{
+
+/*
+ * The position automata of all the patterns are laid out one after another
+ * in a single automaton, each followed by an accepting position that
+ * consumes nothing. Required literals are looked up first with one
+ * Aho-Corasick pass, then the automaton is run once over the input starting
+ * from the patterns whose literals were found. Patterns too large for an
+ * automaton are matched one by one.
+ */
+struct pattern_set::compiled {
+    explicit compiled(std::vector<std::string_view> const& patterns)
+        : compiled(patterns.size())
+    {
+        std::vector<nfa::position> positions;
+        std::vector<std::pair<uint32_t, uint32_t>> accepting;
+        for (uint32_t id = 0; id < patterns.size(); ++id) {
+            auto const& source   = sources.emplace_back(patterns[id]);
+            auto const optimized = optimize(convert_to_table(source));
+            auto const& table    = optimized.table;
+            auto const& member   = members.emplace_back(program{table}, prefilter{table});
+            if (!add(id, member.first, member.second, positions, accepting)) {
+                members.pop_back();
+                fallback.emplace_back(id, pattern{source});
+            }
+        }
+        build(std::move(positions), accepting);
+    }
+
+    // members are stored as their source followed by either a program and a prefilter or,
+    // for the patterns too large for the automaton, a whole pattern
+    explicit compiled(image_reader& image)
+        : compiled(checked_count(image))
+    {
+        std::vector<nfa::position> positions;
+        std::vector<std::pair<uint32_t, uint32_t>> accepting;
+        for (uint32_t id = 0; id < starts.size(); ++id) {
+            sources.emplace_back(image.get_string());
+            if (image.get()) {
+                fallback.emplace_back(id, pattern{image, options{}});
+                continue;
+            }
+            program code{image};
+            prefilter filter{image};
+            if (!add(id, code, filter, positions, accepting))
+                throw std::invalid_argument("corrupted pattern image");
+            members.emplace_back(std::move(code), std::move(filter));
+        }
+        build(std::move(positions), accepting);
+    }
+
+    void save(image_writer& out) const
+    {
+        out.put(sources.size());
+        auto next_member   = members.cbegin();
+        auto next_fallback = fallback.cbegin();
+        for (uint32_t id = 0; id < sources.size(); ++id) {
+            out.put_string(sources[id]);
+            out.put(kNone == starts[id]);
+            if (kNone == starts[id]) {
+                (next_fallback++)->second.save(out);
+                continue;
+            }
+            next_member->first.save(out);
+            (next_member++)->second.save(out);
+        }
+    }
+
+    std::deque<std::string> sources;
+    std::vector<uint32_t> starts;
+    std::vector<uint32_t> accepts;
+    std::vector<std::string> prefixes;
+    std::vector<std::string> suffixes;
+    std::vector<uint32_t> unconditional;
+    literal_automaton literals;
+    std::optional<nfa> automaton;
+    // programs and prefilters of the patterns laid out in the automaton, in order, kept for save
+    std::vector<std::pair<program, prefilter>> members;
+    std::vector<std::pair<uint32_t, pattern>> fallback;
+    scratch_pool<set_scratch> pool;
+
+private:
+    explicit compiled(size_t size)
+        : starts(size, kNone)
+        , prefixes(size)
+        , suffixes(size)
+    {
+    }
+
+    static size_t checked_count(image_reader& image)
+    {
+        auto const size = image.get();
+        if (size > image.remaining())
+            throw std::invalid_argument("corrupted pattern image");
+        return size;
+    }
+
+    // lays the positions of a pattern out after the others, false when they do not fit
+    bool add(
+        uint32_t id,
+        program const& code,
+        prefilter const& filter,
+        std::vector<nfa::position>& positions,
+        std::vector<std::pair<uint32_t, uint32_t>>& accepting)
+    {
+        auto const start = static_cast<uint32_t>(positions.size());
+        try {
+            nfa::append_positions(code, positions);
+        } catch (std::invalid_argument const&) {
+            positions.resize(start);
+            return false;
+        }
+        accepting.emplace_back(static_cast<uint32_t>(positions.size()), id);
+        positions.push_back({});
+        starts[id] = start;
+
+        prefixes[id] = filter.prefix();
+        suffixes[id] = filter.suffix();
+        if (filter.active())
+            literals.add(filter.inner(), id);
+        else
+            unconditional.push_back(id);
+        return true;
+    }
+
+    void build(
+        std::vector<nfa::position> positions,
+        std::vector<std::pair<uint32_t, uint32_t>> const& accepting)
+    {
+        accepts.assign(positions.size(), kNone);
+        for (auto const& [b, id] : accepting)
+            accepts[b] = id;
+
+        literals.build();
+        automaton.emplace(std::move(positions));
+    }
+};
+
+pattern_set::pattern_set(std::vector<std::string_view> const& patterns)
+    : compiled_(std::make_shared<compiled const>(patterns))
+{
+}
+
+pattern_set::pattern_set(std::shared_ptr<compiled const> c) noexcept
+    : compiled_(std::move(c))
+{
+}
+
+std::string pattern_set::save() const
+{
+    image_writer out{image_kind::pattern_set};
+    compiled_->save(out);
+    return std::move(out).finish();
+}
+
+pattern_set pattern_set::load_from_memory(std::string_view image)
+{
+    image_reader in{image, image_kind::pattern_set};
+    auto c = std::make_shared<compiled const>(in);
+    if (!in.done())
+        throw std::invalid_argument("corrupted pattern image");
+    return pattern_set{std::move(c)};
+}
+
+size_t pattern_set::size() const noexcept
+{
+    return compiled_->starts.size();
+}
+
+std::vector<size_t> pattern_set::match(std::string_view s) const
+{
+    std::vector<size_t> ids;
+    match(s, ids);
+    return ids;
+}
+
+bool pattern_set::match_any(std::string_view s) const
+{
+    return match(s, nullptr);
+}
+
+void pattern_set::match(std::string_view s, std::vector<size_t>& ids) const
+{
+    ids.clear();
+    match(s, &ids);
+}
+
+bool pattern_set::match(std::string_view s, std::vector<size_t>* ids) const
+{
+    auto const& c  = *compiled_;
+    auto const& fa = *c.automaton;
+
+    scratch_pool<set_scratch>::lease const leased{c.pool};
+    auto& sc = prepare(*leased, c.accepts.size(), c.literals.size(), c.starts.size());
+
+    c.literals.scan(s, sc.node_stamps, sc.stamp, [&](uint32_t id) {
+        if (sc.stamp != sc.pattern_stamps[id]) {
+            sc.pattern_stamps[id] = sc.stamp;
+            sc.candidates.push_back(id);
+        }
+    });
+    sc.candidates.insert(sc.candidates.end(), c.unconditional.cbegin(), c.unconditional.cend());
+
+    for (auto const id : sc.candidates) {
+        if (s.starts_with(c.prefixes[id]) && s.ends_with(c.suffixes[id]))
+            fa.add_closure(sc.clist, c.starts[id]);
+    }
+
+    for (auto const ch : s) {
+        if (sc.clist.empty())
+            break;
+        fa.step(sc.clist, sc.nlist, static_cast<unsigned char>(ch));
+        std::swap(sc.clist, sc.nlist);
+    }
+
+    bool matched = false;
+    for (auto const b : sc.clist) {
+        if (kNone != c.accepts[b]) {
+            if (!ids)
+                return true;
+            matched = true;
+            ids->push_back(c.accepts[b]);
+        }
+    }
+
+    for (auto const& [id, p] : c.fallback) {
+        if (p.match(s)) {
+            if (!ids)
+                return true;
+            matched = true;
+            ids->push_back(id);
+        }
+    }
+
+    if (ids)
+        std::sort(ids->begin(), ids->end());
+
+    return matched;
+}
+
+} // namespace regexp
@@ -0,0 +1,70 @@
+#include "planner.hpp"
+
+#include <algorithm>
+
+#include "span.hpp"
+
+namespace regexp::detail
+{
+
+std::optional<single_step> single_step::of(program const& code) noexcept
+{
+    auto const instructions = code.code();
+    // the empty pattern is the empty literal
+    if (1 == instructions.size())
+        return single_step{code, {opcode::literal, '\0', 0, 0, 0}};
+    if (2 != instructions.size() || opcode::wildcard_literal == instructions[0].op)
+        return std::nullopt;
+    return single_step{code, instructions[0]};
+}
+
+size_t single_step::span(char const* s, size_t n) const noexcept
+{
+    switch (in_.op) {
+        case opcode::spec_char:
+            return span_char(s, n, in_.c);
+        case opcode::one_of:
+            return span_class(s, n, code_->one_of(in_).accepted);
+        case opcode::any_char:
+        default:
+            return n;
+    }
+}
+
+bool single_step::match(std::string_view s) const noexcept
+{
+    if (is_literal())
+        return s == code_->literal(in_);
+    return in_.m <= s.size() && s.size() <= in_.n && span(s.data(), s.size()) == s.size();
+}
+
+bool single_step::search(std::string_view s) const noexcept
+{
+    return find(s).has_value();
+}
+
+std::optional<std::pair<size_t, size_t>> single_step::find(std::string_view s) const noexcept
+{
+    if (is_literal()) {
+        auto const literal = code_->literal(in_);
+        if (literal.empty())
+            return std::pair<size_t, size_t>{0, 0};
+        if (literal.size() > s.size())
+            return std::nullopt;
+        auto const first = find_literal(s.data(), s.size(), literal);
+        if (first == s.size())
+            return std::nullopt;
+        return std::pair{first, first + literal.size()};
+    }
+
+    // a run shorter than the minimum ends at a byte no match may contain
+    for (size_t first = 0; first + in_.m <= s.size();) {
+        auto const length = span(s.data() + first, std::min<size_t>(s.size() - first, in_.n));
+        if (length >= in_.m)
+            return std::pair{first, first + length};
+        first += length + 1;
+    }
+    return std::nullopt;
+}
+
+} // namespace regexp::detail
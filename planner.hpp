@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+
+#include <optional>
+#include <string_view>
+#include <utility>
+
+#include "program.hpp"
+
+namespace regexp::detail
+{
+
+/*
+ * A program of a single instruction run without an engine. A literal is
+ * compared or looked up as a whole; a repeated character or class is
+ * scanned as one span whose length is checked against the repetition. The
+ * program has to outlive it.
+ */
+class single_step
+{
+public:
+    // none unless the program is a literal without wildcards or a single repetition
+    static std::optional<single_step> of(program const& code) noexcept;
+
+    bool is_literal() const noexcept { return opcode::literal == in_.op; }
+
+    bool match(std::string_view s) const noexcept;
+    bool search(std::string_view s) const noexcept;
+    // leftmost-longest match as offsets [first, last) into s
+    std::optional<std::pair<size_t, size_t>> find(std::string_view s) const noexcept;
+
+private:
+    single_step(program const& code, instruction const& in) noexcept
+        : code_(&code)
+        , in_(in)
+    {
+    }
+
+    // length of the longest prefix of [s, s + n) the repetition accepts, at most n
+    size_t span(char const* s, size_t n) const noexcept;
+
+    program const* code_;
+    instruction in_;
+};
+
+} // namespace regexp::detail
@@ -0,0 +1,147 @@
+#include "prefilter.hpp"
+
+#include <cstdint>
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include "span.hpp"
+
+namespace
+{
+
+using namespace regexp::detail;
+
+struct literal_run {
+    std::string s;
+    bool at_start;
+    bool at_end;
+    // the run starts with the tail of a repetition that ends the previous run
+    bool overlaps;
+};
+
+std::vector<literal_run> required_literals(matcher_table_t const& table)
+{
+    std::vector<literal_run> runs;
+
+    std::string run;
+    bool at_start    = true;
+    bool overlaps    = false;
+    auto const close = [&] {
+        if (!run.empty())
+            runs.push_back({std::move(run), at_start, false, overlaps});
+        run.clear();
+        at_start = false;
+        overlaps = false;
+    };
+
+    for (auto const& matcher : table) {
+        if (auto const* strict = std::get_if<matcher_range_strict>(&matcher)) {
+            for (auto const c : strict->cs) {
+                if ('.' == c)
+                    close();
+                else
+                    run += c;
+            }
+        } else if (auto const* spec = std::get_if<matcher_spec_char>(&matcher)) {
+            auto const k = std::min<size_t>(spec->m, prefilter::max_repeat);
+            run.append(k, spec->c);
+            // the last occurrences of a variable repetition precede what follows it
+            if (spec->m != spec->n || spec->m > prefilter::max_repeat) {
+                close();
+                run.assign(k, spec->c);
+                overlaps = k > 0;
+            }
+        } else {
+            auto const zero_width = std::visit(
+                [](auto const& m) {
+                    if constexpr (std::is_base_of_v<min_max_rule, std::decay_t<decltype(m)>>)
+                        return 0 == m.n;
+                    else
+                        return false;
+                },
+                matcher);
+            if (!zero_width)
+                close();
+        }
+    }
+
+    if (!run.empty())
+        runs.push_back({std::move(run), at_start, true, overlaps});
+
+    return runs;
+}
+
+} // namespace
+
+namespace regexp::detail
+{
+
+prefilter::prefilter(matcher_table_t const& table)
+{
+    auto const runs = required_literals(table);
+    if (runs.empty())
+        return;
+
+    if (runs.front().at_start)
+        prefix_ = runs.front().s;
+    if (runs.back().at_end && !(1 == runs.size() && runs.back().at_start))
+        suffix_ = runs.back().s;
+
+    auto const longest =
+        std::max_element(runs.cbegin(), runs.cend(), [](auto const& a, auto const& b) {
+            return a.s.size() < b.s.size();
+        });
+    inner_          = longest->s;
+    inner_is_affix_ = longest->at_start || longest->at_end;
+    disjoint_       =
+        std::none_of(runs.cbegin(), runs.cend(), [](auto const& r) { return r.overlaps; });
+}
+
+prefilter::prefilter(image_reader& image)
+    : prefix_(image.get_string())
+    , suffix_(image.get_string())
+    , inner_(image.get_string())
+{
+    auto const flags = image.get();
+    inner_is_affix_  = flags & 1;
+    disjoint_        = flags & 2;
+}
+
+void prefilter::save(image_writer& out) const
+{
+    out.put_string(prefix_);
+    out.put_string(suffix_);
+    out.put_string(inner_);
+    out.put((inner_is_affix_ ? 1 : 0) | (disjoint_ ? 2 : 0));
+}
+
+bool prefilter::may_match(std::string_view s) const noexcept
+{
+    if (!active())
+        return true;
+
+    if (disjoint_ && s.size() < prefix_.size() + suffix_.size() || !s.starts_with(prefix_) ||
+        !s.ends_with(suffix_))
+        return false;
+
+    if (inner_is_affix_)
+        return true;
+
+    auto const mid =
+        disjoint_ ? s.substr(prefix_.size(), s.size() - prefix_.size() - suffix_.size()) : s;
+    return find_literal(mid.data(), mid.size(), inner_) != mid.size();
+}
+
+bool prefilter::may_search(std::string_view s) const noexcept
+{
+    if (!active())
+        return true;
+
+    return find_literal(s.data(), s.size(), inner_) != s.size();
+}
+
+} // namespace regexp::detail
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <string>
+#include <string_view>
+
+#include "image.hpp"
+#include "matcher.hpp"
+
+namespace regexp::detail
+{
+
+/*
+ * Literals every match of a table has to contain: the prefix and the suffix
+ * a whole-string match starts and ends with, and the longest literal found
+ * anywhere in the table. Inputs lacking them are rejected before any engine
+ * runs.
+ */
+class prefilter
+{
+public:
+    static constexpr size_t max_repeat = 64;
+
+    explicit prefilter(matcher_table_t const& table);
+    explicit prefilter(image_reader& image);
+
+    void save(image_writer& out) const;
+
+    bool active() const noexcept { return !inner_.empty(); }
+
+    bool may_match(std::string_view s) const noexcept;
+    bool may_search(std::string_view s) const noexcept;
+
+    std::string const& prefix() const noexcept { return prefix_; }
+    std::string const& suffix() const noexcept { return suffix_; }
+    std::string const& inner() const noexcept { return inner_; }
+
+private:
+    std::string prefix_;
+    std::string suffix_;
+    std::string inner_;
+    bool inner_is_affix_ = false;
+    // no literal shares characters with another one, they follow each other in a match
+    bool disjoint_ = true;
+};
+
+} // namespace regexp::detail
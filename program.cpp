@@ -0,0 +1,112 @@
+#include "program.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <variant>
+
+namespace regexp::detail
+{
+
+program::program(matcher_table_t const& table)
+{
+    code_storage_.reserve(table.size() + 1);
+    std::unordered_map<charset, uint32_t, charset_hash> class_ids;
+
+    auto const add_class = [&](charset const& cs) {
+        auto const [it, inserted] = class_ids.try_emplace(cs, classes_storage_.size());
+        if (inserted)
+            classes_storage_.push_back({cs, make_span_table(cs)});
+        return it->second;
+    };
+
+    for (auto const& matcher : table) {
+        code_storage_.push_back(std::visit(
+            [&](auto const& m) -> instruction {
+                using type = std::decay_t<decltype(m)>;
+                if constexpr (std::is_same_v<type, matcher_range_strict>) {
+                    auto& literals = literals_storage_;
+                    if (literals.size() + m.cs.size() > std::numeric_limits<uint32_t>::max())
+                        throw std::invalid_argument("pattern is too large");
+                    auto const offset = static_cast<uint32_t>(literals.size());
+                    auto const size   = static_cast<uint32_t>(m.cs.size());
+                    literals.insert(literals.end(), m.cs.cbegin(), m.cs.cend());
+                    auto const op = std::string_view::npos == m.cs.find('.')
+                                        ? opcode::literal
+                                        : opcode::wildcard_literal;
+                    return {op, 0, size, size, offset};
+                } else if constexpr (std::is_same_v<type, matcher_spec_char>) {
+                    return {opcode::spec_char, m.c, m.m, m.n, 0};
+                } else if constexpr (std::is_same_v<type, matcher_any_char>) {
+                    return {opcode::any_char, 0, m.m, m.n, 0};
+                } else if constexpr (std::is_same_v<type, matcher_range_one_of_char_positive>) {
+                    return {opcode::one_of, 0, m.m, m.n, add_class(m.cs)};
+                } else if constexpr (std::is_same_v<type, matcher_range_one_of_char_negative>) {
+                    return {opcode::one_of, 0, m.m, m.n, add_class(~m.cs)};
+                } else {
+                    static_assert(dependent_false_v<type>, "unhandled matcher type");
+                }
+            },
+            matcher));
+    }
+
+    code_storage_.push_back({opcode::match, 0, 0, 0, 0});
+
+    code_     = code_storage_;
+    literals_ = {literals_storage_.data(), literals_storage_.size()};
+    classes_  = classes_storage_;
+}
+
+program::program(image_reader& image)
+    : code_(image.get_array<instruction>())
+    , literals_(image.get_string())
+    , classes_(image.get_array<char_class>())
+{
+    auto const valid = [&](instruction const& in) {
+        switch (in.op) {
+            case opcode::literal:
+            case opcode::wildcard_literal:
+                return in.m == in.n && in.arg <= literals_.size() &&
+                       in.m <= literals_.size() - in.arg;
+            case opcode::one_of:
+                return in.arg < classes_.size() && in.m <= in.n;
+            case opcode::spec_char:
+            case opcode::any_char:
+                return in.m <= in.n;
+            default:
+                return false;
+        }
+    };
+
+    if (code_.empty() || opcode::match != code_.back().op ||
+        !std::all_of(code_.begin(), code_.end() - 1, valid))
+        throw std::invalid_argument("corrupted program in pattern image");
+}
+
+void program::save(image_writer& out) const
+{
+    out.put_array(code_);
+    out.put_string(literals_);
+    out.put_array(classes_);
+}
+
+charset program::accepted(instruction const& in) const noexcept
+{
+    switch (in.op) {
+        case opcode::spec_char: {
+            charset cs;
+            cs.set(in.c);
+            return cs;
+        }
+        case opcode::any_char:
+            return charset::all();
+        case opcode::one_of:
+            return classes_[in.arg].cs;
+        default:
+            return {};
+    }
+}
+
+} // namespace regexp::detail
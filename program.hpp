@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "image.hpp"
+#include "matcher.hpp"
+#include "span.hpp"
+
+namespace regexp::detail
+{
+
+enum class opcode : uint8_t {
+    // a literal without wildcards, compared as a whole
+    literal,
+    // a literal where '.' matches any character
+    wildcard_literal,
+    spec_char,
+    any_char,
+    // a class, negated classes are stored complemented
+    one_of,
+    // end of the program, the whole input has to be consumed
+    match,
+};
+
+/*
+ * A single step of a program. Literals consume exactly m == n characters
+ * taken from the literal pool at arg, classes refer to the class pool at
+ * arg, every other opcode repeats between m and n times.
+ */
+struct instruction {
+    opcode op;
+    char c;
+    uint32_t m, n;
+    uint32_t arg;
+};
+
+static_assert(sizeof(instruction) == 16);
+static_assert(std::is_trivially_copyable_v<instruction>);
+
+struct char_class {
+    charset cs;
+    span_table accepted;
+};
+
+static_assert(std::is_trivially_copyable_v<char_class>);
+
+/*
+ * Matcher table flattened into a contiguous instruction array terminated by
+ * opcode::match. Literals and classes live in pools shared by the whole
+ * program, so instructions stay small and the engines dispatch on the
+ * opcode without visiting variants. A program read from an image uses the
+ * instructions and the pools of the image in place.
+ */
+class program
+{
+public:
+    explicit program(matcher_table_t const& table);
+    // validates the program read, the image has to outlive it
+    explicit program(image_reader& image);
+    program(program const&)            = delete;
+    program& operator=(program const&) = delete;
+    program(program&&) noexcept        = default;
+
+    void save(image_writer& out) const;
+
+    std::span<instruction const> code() const noexcept { return code_; }
+
+    std::string_view literal(instruction const& in) const noexcept
+    {
+        return {literals_.data() + in.arg, in.m};
+    }
+
+    char_class const& one_of(instruction const& in) const noexcept { return classes_[in.arg]; }
+
+    // characters accepted by an instruction repeating a single character
+    charset accepted(instruction const& in) const noexcept;
+
+private:
+    // storage of a program compiled from a table, the views below refer to it
+    std::vector<instruction> code_storage_;
+    std::vector<char> literals_storage_;
+    std::vector<char_class> classes_storage_;
+
+    std::span<instruction const> code_;
+    std::string_view literals_;
+    std::span<char_class const> classes_;
+};
+
+} // namespace regexp::detail
@@ -1,22 +1,428 @@
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <cerrno>
 #include <cstdint>
 #include <cstring>
 
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <condition_variable>
+#include <fstream>
 #include <iostream>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "regexplib.hpp"
 
-int main(int argc, char const* argv[])
+namespace
 {
-    if (argc < 2) {
-        std::cerr << "no pattern given\n";
-        return EINVAL;
+
+constexpr size_t kOutputBufferSize = 1 << 20;
+constexpr size_t kReadBlockSize    = 1 << 20;
+constexpr size_t kMinChunkSize     = 256 << 10;
+constexpr size_t kMaxChunkSize     = 16 << 20;
+// chunks per worker, small enough chunks let idle workers pick up what is left of a skewed input
+constexpr size_t kChunksPerJob = 8;
+
+class output_buffer
+{
+public:
+    explicit output_buffer(int fd)
+        : fd_(fd)
+    {
+        buf_.reserve(kOutputBufferSize);
+    }
+
+    // the output is flushed explicitly, this only writes what is left when a scan throws
+    ~output_buffer()
+    {
+        try {
+            flush();
+        } catch (std::system_error const& ex) {
+            std::cerr << ex.what() << '\n';
+        }
+    }
+
+    void append(std::string_view data)
+    {
+        if (buf_.size() + data.size() > buf_.capacity())
+            flush();
+        if (data.size() > buf_.capacity()) {
+            write_all(data);
+            return;
+        }
+        buf_.insert(buf_.end(), data.begin(), data.end());
+    }
+
+    void append_line(std::string_view line)
+    {
+        if (buf_.size() + line.size() + 1 > buf_.capacity())
+            flush();
+        if (line.size() + 1 > buf_.capacity()) {
+            write_all(line);
+            write_all("\n");
+            return;
+        }
+        buf_.insert(buf_.end(), line.begin(), line.end());
+        buf_.push_back('\n');
+    }
+
+    // what a failed write leaves in the buffer is dropped, the error is reported once
+    void flush()
+    {
+        try {
+            write_all({buf_.data(), buf_.size()});
+        } catch (...) {
+            buf_.clear();
+            throw;
+        }
+        buf_.clear();
+    }
+
+private:
+    void write_all(std::string_view data)
+    {
+        while (!data.empty()) {
+            auto const n = ::write(fd_, data.data(), data.size());
+            if (n < 0) {
+                if (EINTR == errno)
+                    continue;
+                throw std::system_error(errno, std::generic_category(), "write");
+            }
+            data.remove_prefix(static_cast<size_t>(n));
+        }
+    }
+
+    int const fd_;
+    std::vector<char> buf_;
+};
+
+size_t find_newline(std::string_view data, size_t from) noexcept
+{
+    auto const* const nl =
+        static_cast<char const*>(std::memchr(data.data() + from, '\n', data.size() - from));
+    return nl ? static_cast<size_t>(nl - data.data()) : std::string_view::npos;
+}
+
+// emits complete lines of data accepted by matches, returns the offset of the unterminated tail
+size_t scan_lines(std::string_view data, auto const& matches, auto&& emit)
+{
+    size_t first = 0;
+    for (size_t last; std::string_view::npos != (last = find_newline(data, first));
+         first = last + 1) {
+        auto const line = data.substr(first, last - first);
+        if (matches(line))
+            emit(line);
     }
+    return first;
+}
+
+void scan_all(std::string_view data, auto const& matches, auto&& emit)
+{
+    auto const tail = data.substr(scan_lines(data, matches, emit));
+    if (!tail.empty() && matches(tail))
+        emit(tail);
+}
 
-    for (std::string line; std::cin >> line;) {
-        if (regexp::does_match(line, argv[1]))
-            std::cout << line << std::endl;
+/*
+ * Splits data into line-aligned chunks that workers pick up in turn; the
+ * matching lines of every chunk are collected in its own buffer and written
+ * out in input order as soon as all the preceding chunks are done.
+ */
+void scan_parallel(
+    std::string_view data,
+    auto const& matches,
+    output_buffer& out,
+    unsigned jobs)
+{
+    if (jobs < 2) {
+        scan_all(data, matches, [&](std::string_view line) { out.append_line(line); });
+        return;
     }
 
+    struct chunk {
+        std::string_view data;
+        std::string matched{};
+        bool done = false;
+    };
+
+    auto const chunk_size =
+        std::clamp(data.size() / (jobs * kChunksPerJob), kMinChunkSize, kMaxChunkSize);
+
+    std::vector<chunk> chunks;
+    for (size_t first = 0; first < data.size();) {
+        auto last = std::min(first + chunk_size, data.size());
+        if (last < data.size())
+            last = std::min(find_newline(data, last), data.size() - 1) + 1;
+        chunks.push_back({.data = data.substr(first, last - first)});
+        first = last;
+    }
+
+    std::atomic<size_t> next{0};
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    auto const worker = [&] {
+        for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < chunks.size();) {
+            auto& c = chunks[i];
+            scan_all(c.data, matches, [&](std::string_view line) {
+                c.matched.append(line);
+                c.matched.push_back('\n');
+            });
+            {
+                std::lock_guard lock{mutex};
+                c.done = true;
+            }
+            cv.notify_all();
+        }
+    };
+
+    std::vector<std::jthread> workers;
+    for (unsigned i = 0; i < std::min<size_t>(jobs, chunks.size()); ++i)
+        workers.emplace_back(worker);
+
+    for (auto& c : chunks) {
+        {
+            std::unique_lock lock{mutex};
+            cv.wait(lock, [&] { return c.done; });
+        }
+        out.append(c.matched);
+        std::string{}.swap(c.matched);
+    }
+}
+
+// whether a read would return at once, rather than wait for the writer
+bool readable(int fd) noexcept
+{
+    pollfd pfd{.fd = fd, .events = POLLIN, .revents = 0};
+    return 1 == ::poll(&pfd, 1, 0);
+}
+
+/*
+ * Pipes return little data per read, so with several workers reads are
+ * gathered until every worker gets at least a chunk before the complete
+ * lines are scanned. A single worker scans every read right away. Before
+ * a read would wait for the writer, what was read so far is scanned and
+ * the output flushed, so the lines of a slow pipe come out as they arrive.
+ */
+void scan_stream(int fd, auto const& matches, output_buffer& out, unsigned jobs)
+{
+    auto const batch = jobs < 2 ? 0 : jobs * kMinChunkSize;
+    std::vector<char> buf(std::max<size_t>(kReadBlockSize, batch * kChunksPerJob));
+    size_t filled = 0;
+    // the bytes at the front of the buffer known to hold no newline
+    size_t searched = 0;
+
+    auto const scan_complete = [&] {
+        std::string_view const data{buf.data(), filled};
+        auto const nl = data.substr(searched).rfind('\n');
+        if (std::string_view::npos == nl) {
+            searched = filled;
+            return;
+        }
+        auto const consumed = searched + nl + 1;
+        scan_parallel(data.substr(0, consumed), matches, out, jobs);
+        std::memmove(buf.data(), buf.data() + consumed, filled - consumed);
+        filled -= consumed;
+        searched = filled;
+    };
+
+    for (;;) {
+        if (!readable(fd)) {
+            scan_complete();
+            out.flush();
+        }
+
+        if (filled == buf.size())
+            buf.resize(buf.size() * 2);
+
+        auto const n = ::read(fd, buf.data() + filled, buf.size() - filled);
+        if (n < 0) {
+            if (EINTR == errno)
+                continue;
+            throw std::system_error(errno, std::generic_category(), "read");
+        }
+        if (0 == n)
+            break;
+        filled += static_cast<size_t>(n);
+        // a line longer than the batch is read on until it ends
+        if (filled >= batch)
+            scan_complete();
+    }
+    scan_parallel({buf.data(), filled}, matches, out, jobs);
+}
+
+// maps regular files into memory, everything else is read in large blocks
+void scan_fd(int fd, auto const& matches, output_buffer& out, unsigned jobs)
+{
+    struct stat st;
+    if (0 == ::fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+        auto const size  = static_cast<size_t>(st.st_size);
+        auto* const addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED != addr) {
+            ::madvise(addr, size, MADV_SEQUENTIAL);
+            scan_parallel({static_cast<char const*>(addr), size}, matches, out, jobs);
+            ::munmap(addr, size);
+            return;
+        }
+    }
+    scan_stream(fd, matches, out, jobs);
+}
+
+std::vector<std::string> read_patterns(char const* path)
+{
+    std::ifstream in{path};
+    if (!in)
+        throw std::system_error(errno, std::generic_category(), path);
+
+    // a blank line would be an empty pattern matching only empty lines, it is skipped
+    std::vector<std::string> patterns;
+    for (std::string line; std::getline(in, line);)
+        if (!line.empty())
+            patterns.push_back(std::move(line));
+    return patterns;
+}
+
+int scan_inputs(int argc, char* argv[], auto const& matches, unsigned jobs)
+{
+    output_buffer out{STDOUT_FILENO};
+
+    if (optind >= argc) {
+        scan_fd(STDIN_FILENO, matches, out, jobs);
+        out.flush();
+        return 0;
+    }
+
+    for (int i = optind; i < argc; ++i) {
+        std::string_view const path{argv[i]};
+        if ("-" == path) {
+            scan_fd(STDIN_FILENO, matches, out, jobs);
+            continue;
+        }
+
+        auto const fd = ::open(argv[i], O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            auto const err = errno;
+            out.flush();
+            std::cerr << path << ": " << std::strerror(err) << '\n';
+            return err;
+        }
+        scan_fd(fd, matches, out, jobs);
+        ::close(fd);
+    }
+
+    out.flush();
     return 0;
 }
+
+void print_stats(regexp::match_stats const& st)
+{
+    std::cerr << "calls: " << st.calls << '\n'
+              << "budget exceeded: " << st.budget_exceeded << '\n'
+              << "max depth: " << st.max_depth << '\n'
+              << "matcher visits backtracks bytes\n";
+
+    std::pair<char const*, regexp::matcher_stats> const matchers[] = {
+        {"range_strict", st.range_strict},
+        {"spec_char", st.spec_char},
+        {"any_char", st.any_char},
+        {"one_of_char", st.one_of_char},
+    };
+    for (auto const& [name, m] : matchers)
+        std::cerr << name << ' ' << m.visits << ' ' << m.backtracks << ' ' << m.bytes << '\n';
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    static option const long_options[] = {
+        {"stats", no_argument, nullptr, 's'},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    unsigned jobs             = 1;
+    char const* patterns_file = nullptr;
+    bool stats                = false;
+    for (int opt; -1 != (opt = ::getopt_long(argc, argv, "j:f:", long_options, nullptr));) {
+        switch (opt) {
+            case 'j': {
+                std::string_view const arg{optarg};
+                auto const [ptr, ec] = std::from_chars(arg.begin(), arg.end(), jobs);
+                if (std::errc{} != ec || arg.end() != ptr) {
+                    std::cerr << "invalid number of jobs: " << arg << '\n';
+                    return EINVAL;
+                }
+                jobs = jobs ?: std::max(1u, std::thread::hardware_concurrency());
+            } break;
+            case 'f':
+                patterns_file = optarg;
+                break;
+            case 's':
+                stats = true;
+                break;
+            default:
+                std::cerr << "usage: " << argv[0]
+                          << " [-j JOBS] [--stats] {PATTERN | -f FILE} [FILE...]\n";
+                return EINVAL;
+        }
+    }
+
+    // a pattern set runs a single automaton, there is no backtracker to count
+    if (patterns_file && stats) {
+        std::cerr << "--stats cannot be used with -f\n";
+        return EINVAL;
+    }
+
+    try {
+        if (patterns_file) {
+            auto const sources = read_patterns(patterns_file);
+
+            std::optional<regexp::pattern_set> set;
+            try {
+                set.emplace(std::vector<std::string_view>{sources.begin(), sources.end()});
+            } catch (std::invalid_argument const& ex) {
+                std::cerr << "invalid pattern: " << ex.what() << '\n';
+                return EINVAL;
+            }
+
+            return scan_inputs(
+                argc, argv, [&](std::string_view line) { return set->match_any(line); }, jobs);
+        }
+
+        if (optind >= argc) {
+            std::cerr << "no pattern given\n";
+            return EINVAL;
+        }
+
+        std::optional<regexp::pattern> pattern;
+        try {
+            pattern.emplace(argv[optind++], regexp::options{.collect_stats = stats});
+        } catch (std::invalid_argument const& ex) {
+            std::cerr << "invalid pattern: " << ex.what() << '\n';
+            return EINVAL;
+        }
+
+        auto const ret = scan_inputs(
+            argc, argv, [&](std::string_view line) { return pattern->match(line); }, jobs);
+        if (stats)
+            print_stats(pattern->stats());
+        return ret;
+    } catch (std::system_error const& ex) {
+        std::cerr << ex.what() << '\n';
+        return ex.code().value();
+    }
+}
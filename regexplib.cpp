@@ -1,566 +1,1134 @@
 #include <cstdint>
+#include <cstring>
 
 #include <algorithm>
-#include <functional>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
 #include <iterator>
 #include <limits>
+#include <memory>
+#include <optional>
 #include <stdexcept>
 #include <string>
 #include <string_view>
-#include <tuple>
-#include <type_traits>
+#include <system_error>
+#include <thread>
 #include <utility>
-#include <variant>
 #include <vector>
 
-namespace
+#include "converter.hpp"
+#include "dfa.hpp"
+#include "image.hpp"
+#include "jit.hpp"
+#include "matcher.hpp"
+#include "nfa.hpp"
+#include "optimizer.hpp"
+#include "pattern_cache.hpp"
+#include "planner.hpp"
+#include "prefilter.hpp"
+#include "program.hpp"
+#include "regexplib.hpp"
+#include "scratch.hpp"
+#include "shift_and.hpp"
+#include "span.hpp"
+
+namespace regexp::detail
 {
 
-template <typename Range>
-struct matcher_range {
-    Range cs;
-};
+matcher_table_t convert_to_table(std::string_view p)
+{
+    std::vector<ct::matcher> converted;
+    ct::convert(p, converted);
 
-struct min_max_rule {
-    uint32_t m, n;
-};
+    matcher_table_t table;
+    table.reserve(converted.size());
+    for (auto const& m : converted) {
+        charset cs;
+        cs.bits = m.cs;
+        switch (m.k) {
+            case ct::kind::range_strict:
+                table.push_back(matcher_range_strict{{p.substr(m.first, m.last - m.first)}});
+                break;
+            case ct::kind::spec_char:
+                table.push_back(matcher_spec_char{{m.m, m.n}, m.c});
+                break;
+            case ct::kind::any_char:
+                table.push_back(matcher_any_char{{m.m, m.n}});
+                break;
+            case ct::kind::one_of_char_positive:
+                table.push_back(matcher_range_one_of_char_positive{{{cs}, {m.m, m.n}}});
+                break;
+            case ct::kind::one_of_char_negative:
+                table.push_back(matcher_range_one_of_char_negative{{{cs}, {m.m, m.n}}});
+                break;
+        }
+    }
+    return table;
+}
 
-struct matcher_range_strict : matcher_range<std::string_view> {
-};
+} // namespace regexp::detail
 
-struct matcher_spec_char : min_max_rule {
-    char c;
-};
+namespace
+{
 
-struct matcher_any_char : min_max_rule {
-};
+using namespace regexp::detail;
 
-struct matcher_range_one_of_char : matcher_range<std::vector<char>>, min_max_rule {
-};
+// failed (instruction, input position) pairs of a single run, a row of positions per instruction
+class memo
+{
+public:
+    memo(std::string_view s, program const& prog, std::vector<uint64_t>& bits)
+        : s_first_(s.data())
+        , stride_(s.size() + 1)
+        , bits_(bits)
+    {
+        bits_.assign(words(s.size(), prog.code().size()), 0);
+    }
 
-struct matcher_range_one_of_char_positive : matcher_range_one_of_char {
-};
+    static size_t words(size_t s_size, size_t code_size) noexcept
+    {
+        return (code_size * (s_size + 1) + 63) / 64;
+    }
 
-struct matcher_range_one_of_char_negative : matcher_range_one_of_char {
-};
+    bool failed(char const* s, size_t pc) const noexcept
+    {
+        auto const i = index(s, pc);
+        return bits_[i >> 6] >> (i & 63) & 1;
+    }
 
-/* clang-format off */
-using matcher_t = std::variant<
-  matcher_range_strict,
-  matcher_spec_char,
-  matcher_any_char,
-  matcher_range_one_of_char_positive,
-  matcher_range_one_of_char_negative
->;
-/* clang-format on */
-
-using matcher_table_t = std::vector<matcher_t>;
-
-enum converter_mode {
-    kDefault,
-    kOneOf,
-    kOneOfSpecSym,
-    kOccurrencesSpecMin,
-    kOccurrencesSpecMax,
-    kQty,
-};
+    void set_failed(char const* s, size_t pc) noexcept
+    {
+        auto const i = index(s, pc);
+        bits_[i >> 6] |= uint64_t{1} << (i & 63);
+    }
 
-template <typename InputIt>
-struct converter_ctx {
-    converter_ctx(InputIt b, InputIt e)
-        : f(b)
-        , i(b)
-        , l(e)
+private:
+    size_t index(char const* s, size_t pc) const noexcept
     {
+        return pc * stride_ + static_cast<size_t>(s - s_first_);
     }
 
-    InputIt f;
-    InputIt i;
-    InputIt l;
+    char const* const s_first_;
+    size_t const stride_;
+    std::vector<uint64_t>& bits_;
+};
 
-    uint32_t m, n;
+bool equal_wildcard(char const* s, std::string_view literal) noexcept
+{
+    for (size_t i = 0; i < literal.size(); ++i) {
+        if ('.' != literal[i] && s[i] != literal[i])
+            return false;
+    }
+    return true;
+}
 
-    converter_mode mode = converter_mode::kDefault;
+// steps and counters of an instrumented run, the matchers are indexed by matcher_kind()
+struct run_stats {
+    uint64_t budget    = std::numeric_limits<uint64_t>::max();
+    bool exceeded      = false;
+    uint64_t max_depth = 0;
+    std::array<regexp::matcher_stats, 4> matchers{};
 };
 
-template <typename... Args>
-constexpr bool dependent_false_v = false;
-
-constexpr auto does_allow_zero_occurrences = [](matcher_t const& matcher) {
-    return std::visit(
-        [](auto const& m) {
-            if constexpr (std::is_base_of_v<min_max_rule, std::decay_t<decltype(m)>>)
-                return 0 == m.m;
-            else
-                return false;
-        },
-        matcher);
-};
+size_t matcher_kind(opcode op) noexcept
+{
+    switch (op) {
+        case opcode::spec_char:
+            return 1;
+        case opcode::any_char:
+            return 2;
+        case opcode::one_of:
+            return 3;
+        default:
+            return 0;
+    }
+}
 
-constexpr auto is_zero_more_spec_char_matcher_with = [](matcher_t const& matcher, char c) {
-    return std::holds_alternative<matcher_spec_char>(matcher) &&
-           does_allow_zero_occurrences(matcher) && std::get<matcher_spec_char>(matcher).c == c;
-};
+size_t repetitions(program const& prog) noexcept
+{
+    auto const code = prog.code();
+    return std::count_if(code.begin(), code.end(), [](auto const& in) {
+        return opcode::spec_char == in.op || opcode::any_char == in.op || opcode::one_of == in.op;
+    });
+}
 
-constexpr auto is_zero_more_any_char_matcher = [](matcher_t const& matcher) {
-    return std::holds_alternative<matcher_any_char>(matcher) &&
-           does_allow_zero_occurrences(matcher);
-};
+// every repetition keeps at most one frame, so a run never needs more frames than instructions
+backtrack_frame* backtrack_stack(std::vector<backtrack_frame>& frames, size_t depth)
+{
+    if (frames.size() < depth)
+        frames.resize(depth);
+    return frames.data();
+}
 
-using converter_handler_t = std::function<bool(
-    std::string_view p,
-    converter_ctx<std::string_view::const_iterator>& ctx,
-    matcher_table_t& table)>;
-
-constexpr auto converter_default = [](std::string_view p,
-                                      converter_ctx<std::string_view::const_iterator>& ctx,
-                                      matcher_table_t& table) {
-    if (ctx.i >= ctx.l) {
-        if (ctx.f < ctx.i)
-            table.push_back(matcher_range_strict{{{ctx.f, ctx.i}}});
+/*
+ * Literals are consumed in place, a repetition first measures the longest
+ * run it may take, continues with the shortest one and pushes a frame to
+ * retry the rest of the program after the longer ones. A failure resumes
+ * the latest frame with run lengths left. The frames live in the scratch
+ * space of the run, so neither the input nor the program length grow the
+ * machine stack. An instrumented run counts its steps and gives up once
+ * the budget is exhausted.
+ */
+template <bool kInstrumented>
+bool does_match(
+    program const& prog,
+    char const* first,
+    char const* last,
+    memo* mm,
+    run_stats* rs,
+    scratch_space& sc)
+{
+    auto const code   = prog.code();
+    auto* const stack = backtrack_stack(sc.frames, code.size());
+    size_t depth      = 0;
+    size_t pc         = 0;
+
+    // inlined, it runs on every failed step
+    auto const backtrack = [&]() __attribute__((always_inline)) {
+        for (; depth; --depth) {
+            auto& f = stack[depth - 1];
+            if (f.next <= f.longest) {
+                if constexpr (kInstrumented)
+                    ++rs->matchers[matcher_kind(code[f.pc].op)].backtracks;
+                first = f.first + f.next++;
+                pc    = f.pc + 1;
+                return true;
+            }
+            if (mm)
+                mm->set_failed(f.first, f.pc);
+        }
         return false;
-    }
+    };
 
-    switch (auto const c = *ctx.i; c) {
-        case '[':
-        case '\\':
-            if (ctx.f < ctx.i)
-                table.push_back(matcher_range_strict{{{ctx.f, ctx.i}}});
-            ctx.f    = ctx.i + 1;
-            ctx.mode = '[' == c ? converter_mode::kOneOf : converter_mode::kOneOfSpecSym;
-            break;
-        case '*':
-        case '+':
-        case '?':
-        case '{':
-            if (ctx.f == ctx.i)
-                throw std::invalid_argument(
-                    std::string{"unexpected '"} + c + "' without previous symbol or expression");
-
-            if (ctx.f < ctx.i - 1)
-                table.push_back(matcher_range_strict{{{ctx.f, ctx.i - 1}}});
-
-            switch (c) {
-                case '*':
-                case '+':
-                case '?':
-                    switch (auto const pc = ctx.i[-1]; pc) {
-                        case '.':
-                            while (!table.empty() && does_allow_zero_occurrences(table.back()))
-                                table.pop_back();
-                            table.push_back(matcher_any_char{
-                                {0, '?' == c ? 1 : std::numeric_limits<uint32_t>::max()}});
-                            if ('+' == c)
-                                table.push_back(matcher_any_char{{1, 1}});
-                            break;
-                        default:
-                            if (table.empty() ||
-                                !is_zero_more_any_char_matcher(table.back()) &&
-                                    !is_zero_more_spec_char_matcher_with(table.back(), pc))
-                                table.push_back(matcher_spec_char{
-                                    {0, '?' == c ? 1 : std::numeric_limits<uint32_t>::max()},
-                                    pc});
-                            if ('+' == c)
-                                table.push_back(matcher_spec_char{{1, 1}, pc});
-                            break;
-                    }
-                    break;
-                default:
-                    switch (auto const pc = ctx.i[-1]; pc) {
-                        case '.':
-                            table.push_back(matcher_any_char{{1, 1}});
-                            break;
-                        default:
-                            table.push_back(matcher_spec_char{{1, 1}, pc});
-                            break;
-                    }
-                    ctx.m    = 0;
-                    ctx.n    = 0;
-                    ctx.mode = converter_mode::kOccurrencesSpecMin;
-                    break;
+    for (;;) {
+        auto const& in   = code[pc];
+        auto const avail = static_cast<size_t>(last - first);
+
+        [[maybe_unused]] regexp::matcher_stats* ms = nullptr;
+        if constexpr (kInstrumented) {
+            if (opcode::match != in.op) {
+                if (0 == rs->budget) {
+                    rs->exceeded = true;
+                    return false;
+                }
+                --rs->budget;
+                ms = &rs->matchers[matcher_kind(in.op)];
+                ++ms->visits;
             }
+        }
 
-            ctx.f = ctx.i + 1;
-            break;
-        default:
-            break;
-        case ']':
-            throw std::invalid_argument("unexpected ']' in not opened oneof [] expression");
-        case '}':
-            throw std::invalid_argument(
-                "unexpected '}' in not opened occurrences specifier {} expression");
+        size_t len = 0;
+        switch (in.op) {
+            case opcode::literal:
+                if constexpr (kInstrumented)
+                    ms->bytes += std::min<size_t>(avail, in.m);
+                if (avail >= in.m && 0 == std::memcmp(first, prog.literal(in).data(), in.m)) {
+                    first += in.m;
+                    ++pc;
+                    continue;
+                }
+                if (!backtrack())
+                    return false;
+                continue;
+            case opcode::wildcard_literal:
+                if constexpr (kInstrumented)
+                    ms->bytes += std::min<size_t>(avail, in.m);
+                if (avail >= in.m && equal_wildcard(first, prog.literal(in))) {
+                    first += in.m;
+                    ++pc;
+                    continue;
+                }
+                if (!backtrack())
+                    return false;
+                continue;
+            case opcode::spec_char:
+                len = span_char(first, std::min<size_t>(in.n, avail), in.c);
+                break;
+            case opcode::any_char:
+                len = std::min<size_t>(in.n, avail);
+                break;
+            case opcode::one_of:
+                len = span_class(first, std::min<size_t>(in.n, avail), prog.one_of(in).accepted);
+                break;
+            case opcode::match:
+                if (first == last)
+                    return true;
+                if (!backtrack())
+                    return false;
+                continue;
+        }
+
+        if constexpr (kInstrumented)
+            ms->bytes += len;
+
+        if (len >= in.m && !(mm && mm->failed(first, pc))) {
+            // the last repetition has to consume the rest of the input
+            if (opcode::match == code[pc + 1].op) {
+                if (len == avail)
+                    return true;
+            } else {
+                stack[depth++] = {first, in.m + 1, len, pc};
+                if constexpr (kInstrumented)
+                    rs->max_depth = std::max<uint64_t>(rs->max_depth, depth);
+                first += in.m;
+                ++pc;
+                continue;
+            }
+        }
+
+        if (!backtrack())
+            return false;
     }
-    ++ctx.i;
+}
 
-    return true;
-};
+/*
+ * Whether a suffix of the input matches a suffix of the program depends on
+ * nothing else, so with a memo every such pair is tried once. A try of a
+ * repetition may retry a run length per input offset, so a match takes
+ * O(input^2 x program) steps. The memo is skipped when its bitset does not
+ * fit in memo_size bytes.
+ */
+bool does_match(
+    std::string_view s,
+    program const& prog,
+    scratch_space& sc,
+    size_t memo_size = 0,
+    run_stats* rs    = nullptr)
+{
+    std::optional<memo> mm;
+    if (memo_size && memo::words(s.size(), prog.code().size()) * sizeof(uint64_t) <= memo_size)
+        mm.emplace(s, prog, sc.memo);
+
+    auto* const m = mm ? &*mm : nullptr;
+    if (rs)
+        return does_match<true>(prog, s.data(), s.data() + s.size(), m, rs, sc);
+    return does_match<false>(prog, s.data(), s.data() + s.size(), m, nullptr, sc);
+}
+
+/*
+ * Leftmost-longest match of a program too large for an automaton, in one
+ * sweep over the input. At every offset each instruction boundary holds the
+ * leftmost start reaching it there. An instruction entered at an offset
+ * leads to a span of later offsets, a literal to one and a repetition to
+ * those its run lengths reach, and the spans begin and end in the order
+ * they are entered, so queues kept ordered by their starts spread them in
+ * linear time. Like the nfa, the sweep starts no paths once a match is
+ * found and stops when none that may still improve it is live, so finding
+ * the matches of an input one after another costs about one sweep.
+ */
+std::optional<std::pair<size_t, size_t>> find_longest(
+    std::string_view s,
+    program const& prog,
+    scratch_space& sc)
+{
+    constexpr auto none = std::numeric_limits<size_t>::max();
+    auto const n        = s.size();
+    auto const& code    = prog.code();
+    auto const size     = static_cast<size_t>(
+        std::find_if(code.begin(), code.end(), [](auto const& in) {
+            return opcode::match == in.op;
+        }) -
+        code.begin());
+
+    sc.waiting.resize(size);
+    sc.covering.resize(size);
+    for (size_t i = 0; i < size; ++i) {
+        sc.waiting[i].clear();
+        sc.covering[i].clear();
+    }
+    sc.run_ends.assign(size, 0);
 
-constexpr auto converter_oneof = [](std::string_view p,
-                                    converter_ctx<std::string_view::const_iterator>& ctx,
-                                    matcher_table_t& table) {
-    if (ctx.i >= ctx.l)
-        throw std::invalid_argument("not terminated oneof [] expression");
-
-    switch (auto const c = *ctx.i; c) {
-        case ']': {
-            bool const negate = '^' == *ctx.f;
-            if (negate)
-                ++ctx.f;
-
-            if (ctx.f == ctx.i)
-                throw std::invalid_argument("empty oneof [] expression is impossible");
-
-            std::vector<char> cs{ctx.f, ctx.i};
-            std::sort(cs.begin(), cs.end());
-            cs.erase(std::unique(cs.begin(), cs.end()), cs.end());
-
-            ctx.mode = converter_mode::kDefault;
-
-            uint32_t m = 1, n = 1;
-            if (ctx.i + 1 < ctx.l) {
-                switch (auto const nc = ctx.i[1]; nc) {
-                    case '{':
-                        ctx.m = 0;
-                        ctx.n = 0;
-                        ++ctx.i;
-                        ctx.mode = converter_mode::kOccurrencesSpecMin;
-                        break;
-                    case '*':
-                        m = 0, n = std::numeric_limits<decltype(n)>::max();
-                        ++ctx.i;
-                        break;
-                    case '+':
-                        m = 1, n = std::numeric_limits<decltype(n)>::max();
-                        ++ctx.i;
-                        break;
-                    case '?':
-                        m = 0, n = 1;
-                        ++ctx.i;
-                        break;
-                    default:
-                        break;
+    auto const live = [&] {
+        for (size_t i = 0; i < size; ++i)
+            if (!sc.waiting[i].empty() || !sc.covering[i].empty())
+                return true;
+        return false;
+    };
+
+    std::optional<std::pair<size_t, size_t>> best;
+    for (size_t q = 0; q <= n; ++q) {
+        auto reach = best ? none : q;
+        for (size_t i = 0; i < size; ++i) {
+            auto const& in = code[i];
+            auto& waiting  = sc.waiting[i];
+            auto& covering = sc.covering[i];
+
+            if (none != reach) {
+                if (opcode::literal == in.op || opcode::wildcard_literal == in.op) {
+                    auto const literal = prog.literal(in);
+                    if (q + in.m <= n &&
+                        (opcode::literal == in.op
+                             ? 0 == std::memcmp(s.data() + q, literal.data(), in.m)
+                             : equal_wildcard(s.data() + q, literal)))
+                        waiting.push_back({q + in.m, q + in.m, reach});
+                } else {
+                    // the run is scanned once, from where the previous offsets left it
+                    auto& last       = sc.run_ends[i];
+                    auto const bound = std::min<size_t>(n, q + in.n);
+                    last             = std::max(last, q);
+                    if (last < bound) {
+                        auto const rest = bound - last;
+                        switch (in.op) {
+                            case opcode::spec_char:
+                                last += span_char(s.data() + last, rest, in.c);
+                                break;
+                            case opcode::one_of:
+                                last += span_class(
+                                    s.data() + last, rest, prog.one_of(in).accepted);
+                                break;
+                            default:
+                                last += rest;
+                                break;
+                        }
+                    }
+                    auto const end = std::min(last, bound);
+                    if (end >= q + in.m)
+                        waiting.push_back({q + in.m, end, reach});
                 }
             }
 
-            table.push_back(
-                negate ? matcher_t{matcher_range_one_of_char_negative({{{std::move(cs)}, m, n}})}
-                       : matcher_t{matcher_range_one_of_char_positive({{{std::move(cs)}, m, n}})});
-            ctx.f = ctx.i + 1;
-        } break;
-        case '^':
-            if (ctx.f == ctx.i)
-                break;
-            [[fallthrough]];
-        case '[':
-            throw std::invalid_argument(
-                std::string{"unexpected '"} + c + "' inside opened oneof [] expression");
-        default:
+            // the spans covering an offset are ordered by their starts, the front ends first
+            for (; !waiting.empty() && waiting.front().first <= q; waiting.pop_front()) {
+                while (!covering.empty() && covering.back().start >= waiting.front().start)
+                    covering.pop_back();
+                covering.push_back(waiting.front());
+            }
+            while (!covering.empty() && covering.front().last < q)
+                covering.pop_front();
+            reach = covering.empty() ? none : covering.front().start;
+        }
+
+        if (none != reach && (!best || reach <= best->first)) {
+            // the paths started after the match can no longer improve it
+            if (!best || reach < best->first) {
+                auto const later = [&](reach_span const& r) { return r.start > reach; };
+                for (size_t i = 0; i < size; ++i) {
+                    std::erase_if(sc.waiting[i], later);
+                    std::erase_if(sc.covering[i], later);
+                }
+            }
+            best = std::pair{reach, q};
+        }
+        if (best && !live())
             break;
     }
-    ++ctx.i;
+    return best;
+}
 
-    return true;
-};
+} // namespace
 
-constexpr auto converter_oneof_specsym = [](std::string_view p,
-                                            converter_ctx<std::string_view::const_iterator>& ctx,
-                                            matcher_table_t& table) {
-    if (ctx.i >= ctx.l)
-        throw std::invalid_argument("not terminated oneof [] expression");
-
-    std::vector<char> cs;
-    bool negate = false;
-    switch (auto const c = *ctx.i; c) {
-        case 'd':
-        case 'D':
-            cs     = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9'};
-            negate = 'D' == c;
-            break;
-        case 'w':
-        case 'W':
-            cs = {'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P',
-                  'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z', 'a', 'b', 'c', 'd', 'e', 'f',
-                  'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v',
-                  'w', 'x', 'y', 'z', '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '_'};
-            negate = 'W' == c;
-            break;
-        case 's':
-        case 'S':
-            cs     = {' ', '\f', '\n', '\t', '\v'};
-            negate = 'S' == c;
-            break;
-        case 't':
-            cs = {'\t'};
-            break;
-        case 'r':
-            cs = {'\r'};
-            break;
-        case 'n':
-            cs = {'\n'};
-            break;
-        case 'v':
-            cs = {'\v'};
-            break;
-        case 'f':
-            cs = {'\f'};
-            break;
-        case '0':
-            cs = {'\0'};
-            break;
-        case '\\':
-            cs = {'\\'};
-            break;
-        default:
-            throw std::invalid_argument(
-                std::string{"invalid a special control symbol '"} + c + "' after \\");
+namespace regexp
+{
+
+// bitmap words of a batch a thread takes at once, each word covers 64 rows
+constexpr size_t kBatchChunkWords = 256;
+
+std::atomic<uint64_t> next_pattern_id{0};
+
+scratch::scratch()
+    : space_(std::make_unique<scratch_space>())
+{
+}
+
+scratch::scratch(scratch&&) noexcept            = default;
+scratch& scratch::operator=(scratch&&) noexcept = default;
+scratch::~scratch()                             = default;
+
+struct pattern::compiled {
+    compiled(std::string_view p, options const& opts)
+        : source(p)
+        , engine(opts.engine)
+        , optimized(make_table(source, opts.optimize))
+        , bounds(opts.optimize ? match_length_bounds(optimized.table) : length_bounds{})
+        , code(optimized.table)
+        , search_code(make_search_table(optimized.table))
+        , filter(optimized.table)
+        , use_prefilter(opts.prefilter && filter.active())
+        , memo_size(opts.memoize ? opts.memo_size : 0)
+        , collect_stats(opts.collect_stats)
+        , count_prefilter(opts.count_prefilter)
+    {
+        build_engines(opts);
+    }
+
+    // the values are read in the order save writes them
+    compiled(image_reader& image, options const& opts)
+        : source(image.get_string())
+        , engine(opts.engine)
+        , optimized{{}, {}, {image.get(), image.get(), image.get(), image.get()}}
+        , bounds{image.get(), image.get()}
+        , code(image)
+        , search_code(image)
+        , filter(image)
+        , use_prefilter(opts.prefilter && filter.active())
+        , memo_size(opts.memoize ? opts.memo_size : 0)
+        , collect_stats(opts.collect_stats)
+        , count_prefilter(opts.count_prefilter)
+    {
+        build_engines(opts);
     }
 
-    ctx.mode = converter_mode::kDefault;
+    void save(image_writer& out) const
+    {
+        auto const& r = optimized.rewrites;
+        out.put_string(source);
+        for (auto const v : {r.merged_literals, r.merged_runs, r.folded_classes, r.dropped_repeats})
+            out.put(v);
+        out.put(bounds.min);
+        out.put(bounds.max);
+        code.save(out);
+        search_code.save(out);
+        filter.save(out);
+    }
+
+    void build_engines(options const& opts)
+    {
+        if (opts.jit && !opts.memoize && !opts.collect_stats && engine::backtrack == engine) {
+            auto const start = std::chrono::steady_clock::now();
+            try {
+                native = std::make_unique<jit>(code);
+                jit_time = std::chrono::steady_clock::now() - start;
+            } catch (std::invalid_argument const&) {
+            } catch (std::system_error const&) {
+            }
+        }
 
-    uint32_t m = 1, n = 1;
-    if (ctx.i + 1 < ctx.l) {
-        switch (auto const nc = ctx.i[1]; nc) {
-            case '{':
-                ctx.m = 0;
-                ctx.n = 0;
-                ++ctx.i;
-                ctx.mode = converter_mode::kOccurrencesSpecMin;
+        switch (engine) {
+            case engine::dfa:
+                automaton.emplace(code);
+                lazy_dfa = std::make_unique<dfa>(*automaton, opts.dfa_cache_size);
                 break;
-            case '*':
-                m = 0, n = std::numeric_limits<decltype(n)>::max();
-                ++ctx.i;
+            case engine::nfa:
+                automaton.emplace(code);
                 break;
-            case '+':
-                m = 1, n = std::numeric_limits<decltype(n)>::max();
-                ++ctx.i;
+            case engine::backtrack:
+            default:
+                // searches run on the automaton whenever the pattern fits in one
+                try {
+                    automaton.emplace(code);
+                } catch (std::invalid_argument const&) {
+                }
                 break;
-            case '?':
-                m = 0, n = 1;
-                ++ctx.i;
+        }
+
+        // short patterns run bit-parallel, the automaton is kept for finds and streams
+        if (automaton && automaton->accepting() <= shift_and::max_positions)
+            bit_parallel.emplace(*automaton);
+
+        make_plan(opts);
+
+        // the depth only matters to the programs the plan backtracks through
+        if (strategy::backtrack == plan.match.first &&
+                repetitions(code) > opts.max_backtrack_depth ||
+            strategy::backtrack == plan.search &&
+                repetitions(search_code) > opts.max_backtrack_depth)
+            throw std::invalid_argument("pattern is too deep for the backtrack engine");
+    }
+
+    /*
+     * Patterns of a single instruction need no engine at all. Otherwise the
+     * engine of the options runs the pattern, except that the backtracker
+     * hands the patterns fitting in machine words over to the bit-parallel
+     * engine unless one of its own features was asked for.
+     */
+    void make_plan(options const& opts)
+    {
+        if (opts.plan)
+            direct = single_step::of(code);
+
+        auto const direct_strategy =
+            direct && direct->is_literal() ? strategy::literal : strategy::class_span;
+
+        plan.search = direct         ? direct_strategy
+                      : lazy_dfa     ? strategy::dfa
+                      : bit_parallel ? strategy::bit_parallel
+                      : automaton    ? strategy::nfa
+                                     : strategy::backtrack;
+
+        if (engine::backtrack == engine && collect_stats)
+            plan.match = {strategy::backtrack, "statistics of the backtracker were requested"};
+        else if (direct)
+            plan.match = {
+                direct_strategy,
+                direct->is_literal() ? "the pattern is a single literal"
+                                     : "the pattern is a single repeated character or class"};
+        else if (engine::dfa == engine)
+            plan.match = {strategy::dfa, "the dfa engine was requested"};
+        else if (native)
+            plan.match = {strategy::jit, "native code was requested"};
+        else if (engine::backtrack == engine && opts.memoize)
+            plan.match = {strategy::backtrack, "memoized backtracking was requested"};
+        else if (engine::nfa == engine && bit_parallel)
+            plan.match = {strategy::bit_parallel, "the automaton fits in machine words"};
+        else if (engine::nfa == engine)
+            plan.match = {strategy::nfa, "the automaton is too large for machine words"};
+        else if (!opts.plan)
+            plan.match = {strategy::backtrack, "planning is disabled"};
+        else if (bit_parallel)
+            plan.match = {
+                strategy::bit_parallel,
+                "the automaton fits in machine words, backtracking may take exponential time"};
+        else
+            plan.match = {strategy::backtrack, "the automaton is too large for machine words"};
+
+        if (uses_scratch(plan.match.first) || uses_scratch(plan.search))
+            pool = std::make_unique<scratch_pool<scratch_space>>();
+    }
+
+    // the verdict of the prefilter, counted with options::count_prefilter
+    bool admits(bool may) const noexcept
+    {
+        if (count_prefilter)
+            (may ? counters.prefilter_hits : counters.prefilter_misses)
+                .fetch_add(1, std::memory_order_relaxed);
+        return may;
+    }
+
+    static bool uses_scratch(strategy st) noexcept
+    {
+        return strategy::nfa == st || strategy::dfa == st || strategy::backtrack == st;
+    }
+
+    /*
+     * Runs f on the given scratch space, or on one leased from the pool when
+     * there is none. Patterns whose plans need no scratch have no pool, their
+     * rare finds on the automaton run on a space kept per thread.
+     */
+    template <typename F>
+    auto with_scratch(scratch_space* sc, F&& f) const
+    {
+        if (sc)
+            return f(*sc);
+        if (!pool) {
+            thread_local scratch_space space;
+            return f(space);
+        }
+        scratch_pool<scratch_space>::lease const leased{*pool};
+        return f(*leased);
+    }
+
+    bool match(std::string_view s, scratch_space* sc) const
+    {
+        if (!bounds.contains(s.size()) || use_prefilter && !admits(filter.may_match(s)))
+            return false;
+        return run_match(s, sc);
+    }
+
+    bool run_match(std::string_view s, scratch_space* sc) const
+    {
+        switch (plan.match.first) {
+            case strategy::literal:
+            case strategy::class_span:
+                return direct->match(s);
+            case strategy::bit_parallel:
+                return bit_parallel->match(s);
+            case strategy::jit:
+                return native->match(s);
+            default:
                 break;
+        }
+
+        return with_scratch(sc, [&](scratch_space& space) {
+            switch (plan.match.first) {
+                case strategy::nfa:
+                    return automaton->match(s, space.automaton);
+                case strategy::dfa:
+                    return lazy_dfa->match(s, space.cache_of(id), space.automaton);
+                case strategy::backtrack:
+                default:
+                    return backtrack(s, space);
+            }
+        });
+    }
+
+    // a word of the result bitmap of a batch, rows are the bits of the rows to match
+    uint64_t match_rows(char const* data, size_t const* offsets, uint64_t rows) const
+    {
+        for (auto left = rows; left; left &= left - 1) {
+            auto const i = std::countr_zero(left);
+            std::string_view const row{data + offsets[i], offsets[i + 1] - offsets[i]};
+            if (!bounds.contains(row.size()) || use_prefilter && !admits(filter.may_match(row)))
+                rows &= ~(uint64_t{1} << i);
+        }
+
+        if (!uses_scratch(plan.match.first)) {
+            uint64_t matched = 0;
+            for (; rows; rows &= rows - 1) {
+                auto const i = std::countr_zero(rows);
+                std::string_view const row{data + offsets[i], offsets[i + 1] - offsets[i]};
+                if (run_match(row, nullptr))
+                    matched |= uint64_t{1} << i;
+            }
+            return matched;
+        }
+
+        return with_scratch(nullptr, [&](scratch_space& space) {
+            if (strategy::dfa == plan.match.first)
+                return lazy_dfa->match_rows(
+                    data, offsets, rows, space.cache_of(id), space.automaton);
+
+            uint64_t matched = 0;
+            for (; rows; rows &= rows - 1) {
+                auto const i = std::countr_zero(rows);
+                std::string_view const row{data + offsets[i], offsets[i + 1] - offsets[i]};
+                if (run_match(row, &space))
+                    matched |= uint64_t{1} << i;
+            }
+            return matched;
+        });
+    }
+
+    bool search(std::string_view s, scratch_space* sc) const
+    {
+        if (s.size() < bounds.min || use_prefilter && !admits(filter.may_search(s)))
+            return false;
+
+        switch (plan.search) {
+            case strategy::literal:
+            case strategy::class_span:
+                return direct->search(s);
+            case strategy::bit_parallel:
+                return bit_parallel->search(s);
             default:
                 break;
         }
+
+        return with_scratch(sc, [&](scratch_space& space) {
+            switch (plan.search) {
+                case strategy::dfa:
+                    return lazy_dfa->search(s, space.cache_of(id), space.automaton);
+                case strategy::nfa:
+                    return automaton->search(s, space.automaton);
+                case strategy::backtrack:
+                default:
+                    return ::does_match(s, search_code, space, memo_size);
+            }
+        });
     }
 
-    table.push_back(
-        negate ? matcher_t{matcher_range_one_of_char_negative({{{std::move(cs)}, m, n}})}
-               : matcher_t{matcher_range_one_of_char_positive({{{std::move(cs)}, m, n}})});
-    ctx.f = ctx.i + 1;
+    std::optional<match_span> find(std::string_view s, scratch_space* sc) const
+    {
+        if (s.size() < bounds.min || use_prefilter && !admits(filter.may_search(s)))
+            return std::nullopt;
 
-    ++ctx.i;
+        if (direct) {
+            if (auto const m = direct->find(s))
+                return match_span{m->first, m->second};
+            return std::nullopt;
+        }
 
-    return true;
-};
+        if (!lazy_dfa && bit_parallel && !bit_parallel->search(s))
+            return std::nullopt;
 
-constexpr auto converter_occur_spec_min = [](std::string_view p,
-                                             converter_ctx<std::string_view::const_iterator>& ctx,
-                                             matcher_table_t& table) {
-    if (ctx.i >= ctx.l)
-        throw std::invalid_argument("not terminated occurrences specifier {} expression");
+        return with_scratch(sc, [&](scratch_space& space) -> std::optional<match_span> {
+            if (lazy_dfa && !lazy_dfa->search(s, space.cache_of(id), space.automaton))
+                return std::nullopt;
 
-    switch (auto const c = *ctx.i; c) {
-        case '0' ... '9':
-            ctx.m = ctx.m * 10 + c - '0';
-            break;
-        case '}':
-            if (ctx.f == ctx.i)
-                throw std::invalid_argument(
-                    "empty occurrences specifier {} expression is impossible");
-            ctx.n = ctx.m;
-            std::visit(
-                [&](auto& m) {
-                    if constexpr (std::is_base_of_v<min_max_rule, std::decay_t<decltype(m)>>) {
-                        m.m = ctx.m;
-                        m.n = ctx.n;
-                    } else {
-                        throw std::invalid_argument("invalid type of matcher on the top of table");
-                    }
-                },
-                table.back());
-            ctx.f    = ctx.i + 1;
-            ctx.mode = converter_mode::kDefault;
-            break;
-        case ',':
-            ctx.n    = 0;
-            ctx.f    = ctx.i + 1;
-            ctx.mode = converter_mode::kOccurrencesSpecMax;
-            break;
-        default:
-            throw std::invalid_argument(
-                std::string{"unexpected '"} + c +
-                "' inside opened occurrences specifier {} expression");
-            break;
+            if (automaton) {
+                if (auto const m = automaton->find(s, space.automaton))
+                    return match_span{m->first, m->second};
+                return std::nullopt;
+            }
+
+            if (auto const m = find_longest(s, code, space))
+                return match_span{m->first, m->second};
+            return std::nullopt;
+        });
     }
-    ++ctx.i;
 
-    return true;
-};
+    bool backtrack(std::string_view s, scratch_space& sc) const
+    {
+        if (collect_stats)
+            return match_result::match == backtrack(s, std::numeric_limits<uint64_t>::max(), sc);
+        return ::does_match(s, code, sc, memo_size);
+    }
 
-constexpr auto converter_occur_spec_max = [](std::string_view p,
-                                             converter_ctx<std::string_view::const_iterator>& ctx,
-                                             matcher_table_t& table) {
-    if (ctx.i >= ctx.l)
-        throw std::invalid_argument("not terminated occurrences specifier {} expression");
+    match_result backtrack(std::string_view s, uint64_t max_steps, scratch_space& sc) const
+    {
+        run_stats rs{.budget = max_steps};
+        auto const matched = ::does_match(s, code, sc, memo_size, &rs);
+
+        if (collect_stats) {
+            counters.calls.fetch_add(1, std::memory_order_relaxed);
+            counters.budget_exceeded.fetch_add(rs.exceeded, std::memory_order_relaxed);
+            for (auto depth = counters.max_depth.load(std::memory_order_relaxed);
+                 depth < rs.max_depth && !counters.max_depth.compare_exchange_weak(
+                                             depth, rs.max_depth, std::memory_order_relaxed);)
+                ;
+            for (size_t i = 0; i < rs.matchers.size(); ++i) {
+                auto& c = counters.matchers[i];
+                c[0].fetch_add(rs.matchers[i].visits, std::memory_order_relaxed);
+                c[1].fetch_add(rs.matchers[i].backtracks, std::memory_order_relaxed);
+                c[2].fetch_add(rs.matchers[i].bytes, std::memory_order_relaxed);
+            }
+        }
 
-    switch (auto const c = *ctx.i; c) {
-        case '0' ... '9':
-            ctx.n = ctx.n * 10 + c - '0';
-            break;
-        case '}':
-            ctx.n = ctx.n ?: std::numeric_limits<decltype(ctx.n)>::max();
-            if (ctx.m > ctx.n)
-                throw std::invalid_argument(
-                    "range specified in occurrences specifier {} expression is invalid");
-            std::visit(
-                [&](auto& m) {
-                    if constexpr (std::is_base_of_v<min_max_rule, std::decay_t<decltype(m)>>) {
-                        m.m = ctx.m;
-                        m.n = ctx.n;
-                    } else {
-                        throw std::invalid_argument("invalid type of matcher on the top of table");
-                    }
-                },
-                table.back());
-            ctx.f    = ctx.i + 1;
-            ctx.mode = converter_mode::kDefault;
-            break;
-        default:
-            throw std::invalid_argument(
-                std::string{"unexpected '"} + c +
-                "' inside opened occurrences specifier {} expression");
-            break;
+        if (rs.exceeded)
+            return match_result::budget_exceeded;
+        return matched ? match_result::match : match_result::no_match;
     }
-    ++ctx.i;
 
-    return true;
-};
+    static optimized_table make_table(std::string_view source, bool optimize)
+    {
+        auto table = convert_to_table(source);
+        if (optimize)
+            return detail::optimize(std::move(table));
+        return {std::move(table), {}, {}};
+    }
 
-std::array<converter_handler_t, converter_mode::kQty> const handlers = {
-    converter_default,
-    converter_oneof,
-    converter_oneof_specsym,
-    converter_occur_spec_min,
-    converter_occur_spec_max,
+    static matcher_table_t make_search_table(matcher_table_t const& table)
+    {
+        matcher_table_t search_table;
+        search_table.reserve(table.size() + 2);
+        search_table.push_back(matcher_any_char{{0, std::numeric_limits<uint32_t>::max()}});
+        search_table.insert(search_table.end(), table.cbegin(), table.cend());
+        search_table.push_back(matcher_any_char{{0, std::numeric_limits<uint32_t>::max()}});
+        return search_table;
+    }
+
+    std::string const source;
+    regexp::engine const engine;
+    optimized_table const optimized;
+    length_bounds const bounds;
+    program const code;
+    program const search_code;
+    detail::prefilter const filter;
+    bool const use_prefilter;
+    size_t const memo_size;
+    std::optional<nfa> automaton;
+    std::optional<shift_and> bit_parallel;
+    std::optional<single_step> direct;
+    // the match strategy with the reason it was picked, and the search strategy
+    struct {
+        std::pair<strategy, std::string_view> match;
+        strategy search;
+    } plan;
+    std::unique_ptr<dfa> lazy_dfa;
+    std::unique_ptr<jit> native;
+    std::optional<std::chrono::nanoseconds> jit_time;
+    bool const collect_stats;
+    bool const count_prefilter;
+    // tells the dfa caches of the patterns sharing a scratch apart
+    uint64_t const id = next_pattern_id.fetch_add(1, std::memory_order_relaxed);
+    // scratch spaces of the matches run without one of their own
+    std::unique_ptr<scratch_pool<scratch_space>> pool;
+    // totals of the instrumented backtracker runs, the matchers as visits, backtracks and bytes,
+    // and of the prefilter verdicts
+    mutable struct {
+        std::atomic<uint64_t> prefilter_hits{0};
+        std::atomic<uint64_t> prefilter_misses{0};
+        std::atomic<uint64_t> calls{0};
+        std::atomic<uint64_t> budget_exceeded{0};
+        std::atomic<uint64_t> max_depth{0};
+        std::array<std::array<std::atomic<uint64_t>, 3>, 4> matchers{};
+    } counters;
 };
 
-matcher_table_t convert_to_table(std::string_view p)
+pattern::pattern(std::string_view p, regexp::engine e)
+    : pattern(p, options{.engine = e})
 {
-    matcher_table_t table;
-    for (converter_ctx ctx{p.cbegin(), p.cend()}; handlers[ctx.mode](p, ctx, table);)
-        ;
-    return table;
 }
 
-bool does_match(
-    std::string_view::const_iterator s_first,
-    std::string_view::const_iterator s_last,
-    matcher_table_t::const_iterator tb_first,
-    matcher_table_t::const_iterator tb_last);
-
-auto constexpr does_match_with_matcher_range_strict =
-    [](auto const& m, auto s_first, auto s_last, auto tb_first, auto tb_last) {
-        auto const cmp = [](auto sc, auto pc) { return '.' == pc || sc == pc; };
-        return std::equal(
-                   s_first,
-                   s_first +
-                       std::min(static_cast<size_t>(std::distance(s_last, s_first)), m.cs.size()),
-                   m.cs.cbegin(),
-                   m.cs.cend(),
-                   cmp) &&
-               does_match(s_first + m.cs.size(), s_last, tb_first, tb_last);
-    };
+pattern::pattern(std::string_view p, options const& opts)
+    : compiled_(std::make_shared<compiled const>(p, opts))
+{
+}
 
-auto constexpr range_matcher_gen(auto predicate)
+pattern::pattern(detail::image_reader& image, options const& opts)
+    : compiled_(std::make_shared<compiled const>(image, opts))
 {
-    return [=](auto const& m, auto s_first, auto s_last, auto tb_first, auto tb_last) {
-        uint32_t k = 0;
-        for (; k < m.m && s_first < s_last && predicate(m, s_first, s_last); ++k, ++s_first)
-            ;
+}
 
-        if (k == m.m) {
-            if (does_match(s_first, s_last, tb_first, tb_last))
-                return true;
+std::string pattern::save() const
+{
+    image_writer out{image_kind::pattern};
+    save(out);
+    return std::move(out).finish();
+}
 
-            for (; k < m.n && s_first < s_last && predicate(m, s_first, s_last) &&
-                   !does_match(s_first + 1, s_last, tb_first, tb_last);
-                 ++k, ++s_first)
-                ;
+void pattern::save(detail::image_writer& out) const
+{
+    compiled_->save(out);
+}
+
+pattern pattern::load_from_memory(std::string_view image, options const& opts)
+{
+    image_reader in{image, image_kind::pattern};
+    pattern p{in, opts};
+    if (!in.done())
+        throw std::invalid_argument("corrupted pattern image");
+    return p;
+}
+
+bool pattern::match(std::string_view s) const
+{
+    return compiled_->match(s, nullptr);
+}
+
+bool pattern::match(std::string_view s, scratch& sc) const
+{
+    return compiled_->match(s, sc.space_.get());
+}
+
+match_result pattern::match(std::string_view s, uint64_t max_steps) const
+{
+    auto const planned = compiled_->plan.match.first;
+    if (strategy::backtrack != planned && strategy::jit != planned)
+        return match(s) ? match_result::match : match_result::no_match;
+
+    if (!compiled_->bounds.contains(s.size()) ||
+        compiled_->use_prefilter && !compiled_->admits(compiled_->filter.may_match(s)))
+        return match_result::no_match;
+
+    return compiled_->with_scratch(nullptr, [&](scratch_space& space) {
+        return compiled_->backtrack(s, max_steps, space);
+    });
+}
 
-            return k < m.n && s_first < s_last && predicate(m, s_first, s_last);
+void pattern::match_batch(
+    char const* data,
+    size_t const* offsets,
+    size_t count,
+    uint64_t* out,
+    unsigned jobs) const
+{
+    auto const words = (count + 63) / 64;
+    auto const match_words = [&](size_t first, size_t last) {
+        for (auto w = first; w < last; ++w) {
+            auto const rows = std::min<size_t>(64, count - w * 64);
+            // the rows of the next word are loaded while this one is matched
+            if (w + 1 < words)
+                __builtin_prefetch(data + offsets[(w + 1) * 64]);
+            out[w] = compiled_->match_rows(
+                data, offsets + w * 64, 64 == rows ? ~uint64_t{0} : (uint64_t{1} << rows) - 1);
         }
+    };
 
-        return false;
+    auto const chunks = words / kBatchChunkWords;
+    if (jobs < 2 || chunks < 2) {
+        match_words(0, words);
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    auto const worker = [&] {
+        for (size_t c; (c = next.fetch_add(1, std::memory_order_relaxed)) <= chunks;)
+            match_words(c * kBatchChunkWords, std::min(words, (c + 1) * kBatchChunkWords));
     };
-};
 
-auto constexpr eq_cmp_gen(char c)
+    std::vector<std::jthread> workers;
+    for (unsigned i = 1; i < std::min<size_t>(jobs, chunks); ++i)
+        workers.emplace_back(worker);
+    worker();
+}
+
+bool pattern::search(std::string_view s) const
 {
-    return [=](char ch) { return c == ch; };
-};
+    return compiled_->search(s, nullptr);
+}
 
-auto constexpr does_match_with_matcher_spec_char =
-    range_matcher_gen([](auto const& m, auto s_first, auto s_last) { return m.c == *s_first; });
+bool pattern::search(std::string_view s, scratch& sc) const
+{
+    return compiled_->search(s, sc.space_.get());
+}
 
-auto constexpr does_match_with_matcher_any_char =
-    range_matcher_gen([](auto const& m, auto s_first, auto s_last) { return true; });
+std::optional<match_span> pattern::find(std::string_view s) const
+{
+    return compiled_->find(s, nullptr);
+}
 
-auto constexpr does_match_with_matcher_range_one_of_char_positive =
-    range_matcher_gen([](auto const& m, auto s_first, auto s_last) {
-        return std::ranges::any_of(m.cs, eq_cmp_gen(*s_first));
-    });
+std::optional<match_span> pattern::find(std::string_view s, scratch& sc) const
+{
+    return compiled_->find(s, sc.space_.get());
+}
 
-auto constexpr does_match_with_matcher_range_one_of_char_negative =
-    range_matcher_gen([](auto const& m, auto s_first, auto s_last) {
-        return std::ranges::none_of(m.cs, eq_cmp_gen(*s_first));
-    });
+std::string_view pattern::str() const noexcept
+{
+    return compiled_->source;
+}
 
-auto constexpr matcher_visitor_gen(auto&&... args)
-{
-    return [... args = std::forward<decltype(args)>(args)](auto const& m) {
-        if constexpr (std::is_same_v<std::decay_t<decltype(m)>, matcher_range_strict>) {
-            return does_match_with_matcher_range_strict(m, args...);
-        } else if constexpr (std::is_same_v<std::decay_t<decltype(m)>, matcher_spec_char>) {
-            return does_match_with_matcher_spec_char(m, args...);
-        } else if constexpr (std::is_same_v<std::decay_t<decltype(m)>, matcher_any_char>) {
-            return does_match_with_matcher_any_char(m, args...);
-        } else if constexpr (std::is_same_v<
-                                 std::decay_t<decltype(m)>,
-                                 matcher_range_one_of_char_positive>) {
-            return does_match_with_matcher_range_one_of_char_positive(m, args...);
-        } else if constexpr (std::is_same_v<
-                                 std::decay_t<decltype(m)>,
-                                 matcher_range_one_of_char_negative>) {
-            return does_match_with_matcher_range_one_of_char_negative(m, args...);
-        } else {
-            static_assert(dependent_false_v<std::decay_t<decltype(m)>>, "unhandled matcher type");
-        }
+prefilter_stats pattern::prefilter() const noexcept
+{
+    auto const& c = compiled_->counters;
+    return {
+        c.prefilter_hits.load(std::memory_order_relaxed),
+        c.prefilter_misses.load(std::memory_order_relaxed)};
+}
+
+optimizer_report pattern::optimizer() const noexcept
+{
+    auto const& rewrites = compiled_->optimized.rewrites;
+    auto const& bounds   = compiled_->bounds;
+    return {
+        rewrites.merged_literals,
+        rewrites.merged_runs,
+        rewrites.folded_classes,
+        rewrites.dropped_repeats,
+        bounds.min,
+        length_bounds::unbounded == bounds.max ? std::nullopt : std::optional{bounds.max},
     };
-};
+}
 
-bool does_match(
-    std::string_view::const_iterator s_first,
-    std::string_view::const_iterator s_last,
-    matcher_table_t::const_iterator tb_first,
-    matcher_table_t::const_iterator tb_last)
+query_plan pattern::explain() const noexcept
 {
-    return s_first < s_last && tb_first < tb_last &&
-               std::visit(matcher_visitor_gen(s_first, s_last, tb_first + 1, tb_last), *tb_first) ||
-           s_first >= s_last && std::all_of(tb_first, tb_last, does_allow_zero_occurrences);
+    auto const& plan = compiled_->plan;
+    return {plan.match.first, plan.search, plan.match.second};
 }
 
-bool does_match(std::string_view s, matcher_table_t const& tb)
+match_stats pattern::stats() const noexcept
 {
-    return does_match(s.cbegin(), s.cend(), tb.cbegin(), tb.cend());
+    auto const& c      = compiled_->counters;
+    auto const load    = [](auto const& v) { return v.load(std::memory_order_relaxed); };
+    auto const matcher = [&](size_t i) -> matcher_stats {
+        return {load(c.matchers[i][0]), load(c.matchers[i][1]), load(c.matchers[i][2])};
+    };
+    return {
+        load(c.calls),
+        load(c.budget_exceeded),
+        load(c.max_depth),
+        matcher(0),
+        matcher(1),
+        matcher(2),
+        matcher(3),
+    };
 }
-} // namespace
 
-namespace regexp
+std::optional<std::chrono::nanoseconds> pattern::jit_compile_time() const noexcept
 {
+    return compiled_->jit_time;
+}
 
 bool does_match(std::string_view s, std::string_view p)
 {
-    return does_match(s, convert_to_table(p));
+    return detail::cached_pattern(p).match(s);
+}
+
+bool does_match(std::string_view s, pattern const& p)
+{
+    return p.match(s);
+}
+
+std::optional<match_span> search(std::string_view s, std::string_view p)
+{
+    return detail::cached_pattern(p).find(s);
+}
+
+std::optional<match_span> search(std::string_view s, pattern const& p)
+{
+    return p.find(s);
+}
+
+struct stream_matcher::state {
+    state(pattern const& p, stream_matcher::mode m)
+        : p(p)
+        , automaton(p.compiled_->automaton ? &*p.compiled_->automaton : nullptr)
+        , mode(m)
+    {
+        if (automaton) {
+            clist.reserve(automaton->accepting() + 1);
+            nlist.reserve(automaton->accepting() + 1);
+        }
+        start();
+    }
+
+    void start()
+    {
+        buffered.clear();
+        if (!automaton)
+            return;
+
+        clist.clear();
+        automaton->add_closure(clist, 0);
+        decided = stream_matcher::mode::search == mode && clist.contains(automaton->accepting());
+    }
+
+    pattern const p;
+    nfa const* const automaton;
+    stream_matcher::mode const mode;
+    sparse_set clist;
+    sparse_set nlist;
+    std::string buffered;
+    // the outcome no longer depends on the rest of the input once a search found a match or
+    // no thread of a full match is alive
+    bool decided = false;
+};
+
+stream_matcher::stream_matcher(pattern const& p, mode m)
+    : state_(std::make_unique<state>(p, m))
+{
+}
+
+stream_matcher::stream_matcher(stream_matcher&&) noexcept            = default;
+stream_matcher& stream_matcher::operator=(stream_matcher&&) noexcept = default;
+stream_matcher::~stream_matcher()                                    = default;
+
+void stream_matcher::feed(std::string_view chunk)
+{
+    auto& st = *state_;
+    if (!st.automaton) {
+        st.buffered.append(chunk);
+        return;
+    }
+
+    auto const unanchored = mode::search == st.mode;
+    for (size_t i = 0; i < chunk.size() && !st.decided; ++i) {
+        st.automaton->step(st.clist, st.nlist, static_cast<unsigned char>(chunk[i]));
+        if (unanchored)
+            st.automaton->add_closure(st.nlist, 0);
+        std::swap(st.clist, st.nlist);
+        st.decided = unanchored ? st.clist.contains(st.automaton->accepting()) : st.clist.empty();
+    }
+}
+
+bool stream_matcher::finish()
+{
+    auto& st = *state_;
+
+    bool matched;
+    if (!st.automaton)
+        matched = mode::match == st.mode ? st.p.match(st.buffered) : st.p.search(st.buffered);
+    else
+        matched = st.clist.contains(st.automaton->accepting());
+
+    st.start();
+    return matched;
+}
+
+match_iterator::match_iterator(std::string_view s, pattern const& p)
+    : s_(s)
+    , p_(&p)
+{
+    next(0);
+}
+
+match_iterator& match_iterator::operator++()
+{
+    next(m_->length() ? m_->last : m_->last + 1);
+    return *this;
+}
+
+match_iterator match_iterator::operator++(int)
+{
+    auto it = *this;
+    ++*this;
+    return it;
+}
+
+void match_iterator::next(size_t from)
+{
+    m_.reset();
+    if (from > s_.size())
+        return;
+
+    if (auto const m = p_->find(s_.substr(from)))
+        m_ = match_span{from + m->first, from + m->last};
+}
+
+match_range find_all(std::string_view s, pattern const& p)
+{
+    return {s, p};
 }
 
 } // namespace regexp
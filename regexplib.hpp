@@ -1,6 +1,353 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <chrono>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
 #include <string_view>
+#include <vector>
 
 namespace regexp
 {
+
+namespace detail
+{
+class image_reader;
+class image_writer;
+struct scratch_space;
+} // namespace detail
+
+enum class engine {
+    // backtracking over the program on an explicit stack, may take exponential time
+    backtrack,
+    // position automaton simulation, O(input x pattern) time, bit-parallel for short patterns
+    nfa,
+    // lazily built deterministic automaton, one table lookup per input byte
+    dfa,
+};
+
+struct options {
+    regexp::engine engine = regexp::engine::backtrack;
+    // memory budget of the dfa state cache in bytes, the cache is flushed when it is exhausted
+    std::size_t dfa_cache_size = 1 << 20;
+    // reject inputs lacking the literals every match contains before running the engine
+    bool prefilter = true;
+    // count the inputs the prefilter lets through and rejects, see pattern::prefilter()
+    bool count_prefilter = false;
+    // simplify the matcher table and reject inputs of impossible lengths before running the engine
+    bool optimize = true;
+    // run every pattern with the cheapest strategy giving the results of the engine, see explain()
+    bool plan = true;
+    // remember failed (matcher, position) pairs in the backtracker, O(input^2 x pattern) matching
+    bool memoize = false;
+    // memory budget of the memo bitset in bytes, larger inputs are matched without it
+    std::size_t memo_size = 1 << 20;
+    // run full matches of the backtracker as native code where supported, ignored with memoize
+    bool jit = false;
+    // count the work of the backtracker, see pattern::stats(), disables the jit
+    bool collect_stats = false;
+    // repetitions the backtracker may have to retry at once, patterns it runs with more throw
+    std::size_t max_backtrack_depth = 1 << 16;
+};
+
+enum class match_result {
+    no_match,
+    match,
+    // the step budget ran out before the outcome was known
+    budget_exceeded,
+};
+
+struct matcher_stats {
+    std::uint64_t visits;
+    // run lengths retried after the rest of the pattern failed to match
+    std::uint64_t backtracks;
+    // input bytes compared or scanned
+    std::uint64_t bytes;
+};
+
+// totals of the backtracker runs of a pattern compiled with options::collect_stats
+struct match_stats {
+    std::uint64_t calls;
+    std::uint64_t budget_exceeded;
+    // most repetitions a single run had left to retry at once
+    std::uint64_t max_depth;
+    matcher_stats range_strict;
+    matcher_stats spec_char;
+    matcher_stats any_char;
+    matcher_stats one_of_char;
+};
+
+// inputs seen by the prefilter of a pattern compiled with options::count_prefilter
+struct prefilter_stats {
+    // inputs containing the required literals, handed over to the engine
+    std::uint64_t hits;
+    // inputs rejected by the prefilter alone
+    std::uint64_t misses;
+};
+
+// rewrites of the matcher table done on compilation, counted in matchers removed
+struct optimizer_report {
+    std::size_t merged_literals;
+    std::size_t merged_runs;
+    std::size_t folded_classes;
+    std::size_t dropped_repeats;
+    // lengths of the inputs the pattern may match, max_length is none when unbounded
+    std::size_t min_length;
+    std::optional<std::size_t> max_length;
+};
+
+// ways of running a compiled pattern
+enum class strategy {
+    // comparison with the literal the pattern consists of
+    literal,
+    // a scan over the character or class the pattern repeats, then a length check
+    class_span,
+    // the automaton simulated in machine words
+    bit_parallel,
+    nfa,
+    dfa,
+    // the backtracker compiled to native code
+    jit,
+    backtrack,
+};
+
+// strategies picked for a pattern on compilation from its program and its options
+struct query_plan {
+    // run by match and match_batch
+    strategy match;
+    // run by search and find
+    strategy search;
+    // why the match strategy was picked
+    std::string_view reason;
+};
+
+// a match as offsets [first, last) into the input
+struct match_span {
+    std::size_t first;
+    std::size_t last;
+
+    std::size_t length() const noexcept { return last - first; }
+
+    bool operator==(match_span const&) const noexcept = default;
+};
+
+/*
+ * Buffers a match works in. A pattern matched without one takes buffers
+ * from a lock-free pool of its own, callers running their threads may keep
+ * a scratch per thread and pass it to every match instead. A scratch is
+ * used by one thread at a time and may serve any number of patterns; it
+ * keeps a dfa cache for every pattern of the dfa engine it was used with.
+ */
+class scratch
+{
+public:
+    scratch();
+    scratch(scratch&&) noexcept;
+    scratch& operator=(scratch&&) noexcept;
+    ~scratch();
+
+private:
+    friend class pattern;
+
+    std::unique_ptr<detail::scratch_space> space_;
+};
+
+/*
+ * A compiled pattern never changes after construction, so it may be shared
+ * by any number of threads.
+ */
+class pattern
+{
+public:
+    explicit pattern(std::string_view p, engine e = engine::backtrack);
+    pattern(std::string_view p, options const& opts);
+
+    bool match(std::string_view s) const;
+    bool match(std::string_view s, scratch& sc) const;
+    // as match, the backtracker gives up after max_steps matcher visits, other strategies do not
+    match_result match(std::string_view s, std::uint64_t max_steps) const;
+    /*
+     * Matches a column of count rows, row i being [data + offsets[i], data + offsets[i + 1]),
+     * and sets bit i % 64 of out[i / 64] when it matches. out holds (count + 63) / 64 words.
+     * Large columns are split between up to jobs threads.
+     */
+    void match_batch(
+        char const* data,
+        std::size_t const* offsets,
+        std::size_t count,
+        std::uint64_t* out,
+        unsigned jobs = 1) const;
+    bool search(std::string_view s) const;
+    bool search(std::string_view s, scratch& sc) const;
+    // leftmost-longest match of the pattern within s
+    std::optional<match_span> find(std::string_view s) const;
+    std::optional<match_span> find(std::string_view s, scratch& sc) const;
+
+    /*
+     * Versioned binary image of the compiled pattern. A load does not parse
+     * the pattern again: the instructions, literals and classes of the
+     * program are used in place, so the image has to stay unchanged,
+     * outlive the pattern and be aligned to 16 bytes as mmap and operator
+     * new provide. Everything else is allocated on load: the source text
+     * and the prefilter literals are copied, and the automaton positions,
+     * the bit-parallel masks, the lazy dfa, the jit code and the scratch
+     * pool are rebuilt from the program in time linear in its size. The
+     * engine and the other options are chosen on load, the optimizer
+     * rewrites are kept in the image. Loading throws std::invalid_argument
+     * when the image is corrupted or was written by an incompatible
+     * version or platform.
+     */
+    std::string save() const;
+    static pattern load_from_memory(std::string_view image, options const& opts = {});
+
+    std::string_view str() const noexcept;
+    regexp::prefilter_stats prefilter() const noexcept;
+    regexp::optimizer_report optimizer() const noexcept;
+    query_plan explain() const noexcept;
+    match_stats stats() const noexcept;
+    // time spent generating native code, none when the pattern runs interpreted
+    std::optional<std::chrono::nanoseconds> jit_compile_time() const noexcept;
+
+private:
+    friend class stream_matcher;
+    friend class pattern_set;
+
+    pattern(detail::image_reader& image, options const& opts);
+
+    void save(detail::image_writer& out) const;
+
+    struct compiled;
+    std::shared_ptr<compiled const> compiled_;
+};
+
+/*
+ * Matches an input given in consecutive chunks. Only the automaton state is
+ * carried between chunks, the chunks themselves are not kept, except for
+ * patterns too large for an automaton whose input is buffered until finish.
+ */
+class stream_matcher
+{
+public:
+    enum class mode {
+        // the whole input has to match, as pattern::match
+        match,
+        // a part of the input has to match, as pattern::search
+        search,
+    };
+
+    explicit stream_matcher(pattern const& p, mode m = mode::match);
+    stream_matcher(stream_matcher&&) noexcept;
+    stream_matcher& operator=(stream_matcher&&) noexcept;
+    ~stream_matcher();
+
+    void feed(std::string_view chunk);
+    // whether the input fed so far matches, the next feed starts a new input
+    bool finish();
+
+private:
+    struct state;
+    std::unique_ptr<state> state_;
+};
+
+// iterates over the non-overlapping leftmost-longest matches of a pattern
+class match_iterator
+{
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type        = match_span;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = match_span const*;
+    using reference         = match_span const&;
+
+    match_iterator() = default;
+    match_iterator(std::string_view s, pattern const& p);
+
+    reference operator*() const noexcept { return *m_; }
+    pointer operator->() const noexcept { return &*m_; }
+
+    match_iterator& operator++();
+    match_iterator operator++(int);
+
+    bool operator==(match_iterator const& other) const noexcept { return m_ == other.m_; }
+
+private:
+    void next(std::size_t from);
+
+    std::string_view s_;
+    pattern const* p_ = nullptr;
+    std::optional<match_span> m_;
+};
+
+class match_range
+{
+public:
+    match_range(std::string_view s, pattern const& p)
+        : s_(s)
+        , p_(&p)
+    {
+    }
+
+    match_iterator begin() const { return {s_, *p_}; }
+    match_iterator end() const noexcept { return {}; }
+
+private:
+    std::string_view s_;
+    pattern const* p_;
+};
+
+// many patterns compiled together and matched against an input in one pass
+class pattern_set
+{
+public:
+    explicit pattern_set(std::vector<std::string_view> const& patterns);
+
+    std::size_t size() const noexcept;
+
+    // ids, the indices of the patterns given on construction, of the patterns matching the whole s
+    std::vector<std::size_t> match(std::string_view s) const;
+    void match(std::string_view s, std::vector<std::size_t>& ids) const;
+    bool match_any(std::string_view s) const;
+
+    // binary image of the set, as pattern::save and pattern::load_from_memory, the combined
+    // automaton of the set is rebuilt on load
+    std::string save() const;
+    static pattern_set load_from_memory(std::string_view image);
+
+private:
+    struct compiled;
+
+    explicit pattern_set(std::shared_ptr<compiled const> c) noexcept;
+
+    bool match(std::string_view s, std::vector<std::size_t>* ids) const;
+
+    std::shared_ptr<compiled const> compiled_;
+};
+
+struct cache_stats {
+    std::uint64_t hits;
+    std::uint64_t misses;
+    std::uint64_t evictions;
+    // patterns currently cached
+    std::size_t size;
+    std::size_t capacity;
+};
+
+// the entry points taking pattern text keep recently used patterns compiled in a process-wide cache
+cache_stats pattern_cache_stats();
+// 0 disables the cache, patterns beyond the new capacity are evicted
+void set_pattern_cache_capacity(std::size_t capacity);
+
 bool does_match(std::string_view s, std::string_view p);
+bool does_match(std::string_view s, pattern const& p);
+
+std::optional<match_span> search(std::string_view s, std::string_view p);
+std::optional<match_span> search(std::string_view s, pattern const& p);
+
+// the pattern has to outlive the range and its iterators
+match_range find_all(std::string_view s, pattern const& p);
+
 } // namespace regexp
@@ -0,0 +1,28 @@
+#include "scratch.hpp"
+
+namespace regexp::detail
+{
+
+dfa::cache& scratch_space::cache_of(uint64_t pattern_id)
+{
+    if (auto const it = cache_index.find(pattern_id); cache_index.end() != it) {
+        caches.splice(caches.begin(), caches, it->second);
+        return it->second->second;
+    }
+
+    // the caches grow while they are used, so their sizes are only summed up here
+    size_t bytes = 0;
+    for (auto const& c : caches)
+        bytes += c.second.size();
+    while (!caches.empty() && (caches.size() >= max_caches || bytes > max_cache_bytes)) {
+        bytes -= caches.back().second.size();
+        cache_index.erase(caches.back().first);
+        caches.pop_back();
+    }
+
+    caches.emplace_front(pattern_id, dfa::cache{});
+    cache_index.emplace(pattern_id, caches.begin());
+    return caches.front().second;
+}
+
+} // namespace regexp::detail
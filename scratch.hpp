@@ -0,0 +1,200 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "dfa.hpp"
+#include "nfa.hpp"
+
+namespace regexp::detail
+{
+
+// a repetition entered at first whose run lengths from next to longest are left to try
+struct backtrack_frame {
+    char const* first;
+    size_t next;
+    size_t longest;
+    size_t pc;
+};
+
+// offsets from first to last an instruction leads to on a path started at start
+struct reach_span {
+    size_t first;
+    size_t last;
+    size_t start;
+};
+
+// buffers a single match works in, grown to the largest match run with them
+struct scratch_space {
+    // dfa caches kept at most, by number and by bytes of states, the least recently used go first
+    static constexpr size_t max_caches      = 64;
+    static constexpr size_t max_cache_bytes = 16 << 20;
+
+    // the lazy dfa cache of a pattern, created on first use
+    dfa::cache& cache_of(uint64_t pattern_id);
+
+    std::vector<backtrack_frame> frames;
+    std::vector<uint64_t> memo;
+    nfa::buffers automaton;
+    // spans every instruction leads to, before and while they cover an offset, see find_longest
+    std::vector<std::deque<reach_span>> waiting;
+    std::vector<std::deque<reach_span>> covering;
+    std::vector<size_t> run_ends;
+    // dfa caches with the ids of the patterns they belong to, the most recently used first
+    std::list<std::pair<uint64_t, dfa::cache>> caches;
+    std::unordered_map<uint64_t, decltype(caches)::iterator> cache_index;
+};
+
+/*
+ * Pool of scratch objects shared by the threads running the same compiled
+ * pattern. A thread takes an object out of a slot with a single exchange,
+ * probing a few slots from one picked by its id so that threads rarely
+ * meet on the same ones, and puts it back the same way. The slots, two per
+ * hardware thread, are allocated on the first lease, so a pool never used
+ * costs a few words. The objects finding no free slot are kept warm in a
+ * list under a lock, so the pool grows to the most callers it served at
+ * once and never frees an object before it is destroyed itself.
+ */
+template <typename T>
+class scratch_pool
+{
+public:
+    static constexpr size_t min_slots  = 16;
+    static constexpr size_t max_probes = 4;
+
+    // an object of the pool put back on destruction
+    class lease
+    {
+    public:
+        explicit lease(scratch_pool const& pool)
+            : pool_(pool)
+            , object_(pool.acquire())
+        {
+        }
+
+        lease(lease const&)            = delete;
+        lease& operator=(lease const&) = delete;
+
+        ~lease() { pool_.release(std::move(object_)); }
+
+        T& operator*() const noexcept { return *object_; }
+        T* operator->() const noexcept { return object_.get(); }
+
+    private:
+        scratch_pool const& pool_;
+        std::unique_ptr<T> object_;
+    };
+
+    scratch_pool() = default;
+
+    scratch_pool(scratch_pool const&)            = delete;
+    scratch_pool& operator=(scratch_pool const&) = delete;
+
+    ~scratch_pool()
+    {
+        if (auto* const slots = slots_.load(std::memory_order_acquire)) {
+            for (size_t i = 0; i < size(); ++i)
+                delete slots[i].object.load(std::memory_order_relaxed);
+            delete[] slots;
+        }
+    }
+
+private:
+    // slots on separate cache lines, threads probing neighbouring slots do not share them
+    struct alignas(64) slot {
+        std::atomic<T*> object{nullptr};
+    };
+
+    static size_t size() noexcept
+    {
+        static size_t const n =
+            std::bit_ceil(std::max<size_t>(min_slots, 2 * std::thread::hardware_concurrency()));
+        return n;
+    }
+
+    static size_t home() noexcept
+    {
+        thread_local size_t const h = std::hash<std::thread::id>{}(std::this_thread::get_id());
+        return h;
+    }
+
+    slot* slots() const
+    {
+        if (auto* const slots = slots_.load(std::memory_order_acquire))
+            return slots;
+        auto fresh     = std::make_unique<slot[]>(size());
+        slot* expected = nullptr;
+        if (slots_.compare_exchange_strong(expected, fresh.get(), std::memory_order_acq_rel))
+            return fresh.release();
+        return expected;
+    }
+
+    std::unique_ptr<T> acquire() const
+    {
+        auto* const slots = this->slots();
+        for (size_t i = 0, h = home(); i < max_probes; ++i) {
+            auto& s = slots[(h + i) & (size() - 1)].object;
+            if (s.load(std::memory_order_relaxed)) {
+                if (auto* const object = s.exchange(nullptr, std::memory_order_acquire))
+                    return std::unique_ptr<T>{object};
+            }
+        }
+
+        if (spilled_.load(std::memory_order_relaxed)) {
+            std::lock_guard lock{mutex_};
+            if (!spill_.empty()) {
+                auto object = std::move(spill_.back());
+                spill_.pop_back();
+                spilled_.store(spill_.size(), std::memory_order_relaxed);
+                return object;
+            }
+        }
+        return std::make_unique<T>();
+    }
+
+    // only leased objects come back, so the slots exist
+    void release(std::unique_ptr<T> object) const noexcept
+    {
+        auto* const slots = slots_.load(std::memory_order_acquire);
+        for (size_t i = 0, h = home(); i < max_probes; ++i) {
+            auto& s     = slots[(h + i) & (size() - 1)].object;
+            T* expected = nullptr;
+            if (!s.load(std::memory_order_relaxed) &&
+                s.compare_exchange_strong(
+                    expected, object.get(), std::memory_order_release, std::memory_order_relaxed)) {
+                object.release();
+                return;
+            }
+        }
+
+        // an object the list has no room for is freed
+        std::lock_guard lock{mutex_};
+        try {
+            spill_.push_back(std::move(object));
+            spilled_.store(spill_.size(), std::memory_order_relaxed);
+        } catch (std::bad_alloc const&) {
+        }
+    }
+
+    mutable std::atomic<slot*> slots_{nullptr};
+    // objects returned while the slots probed were taken
+    mutable std::mutex mutex_;
+    mutable std::vector<std::unique_ptr<T>> spill_;
+    mutable std::atomic<size_t> spilled_{0};
+};
+
+} // namespace regexp::detail
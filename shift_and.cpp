@@ -0,0 +1,145 @@
+#include "shift_and.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <stdexcept>
+
+namespace
+{
+
+template <size_t kWords>
+using bits = std::array<uint64_t, kWords>;
+
+template <size_t kWords>
+bits<kWords> load(std::vector<uint64_t> const& v) noexcept
+{
+    bits<kWords> r;
+    std::copy_n(v.cbegin(), kWords, r.begin());
+    return r;
+}
+
+/*
+ * Adding the active boundaries within a run of optional positions to the
+ * run clears it from the lowest of them up and carries into the boundary
+ * past the run, so the bits changed by the addition are the boundaries
+ * reachable without consuming input.
+ */
+template <size_t kWords>
+void close(bits<kWords>& d, bits<kWords> const& optional) noexcept
+{
+    uint64_t carry = 0;
+    for (size_t w = 0; w < kWords; ++w) {
+        auto const sum   = optional[w] + (d[w] & optional[w]);
+        auto const total = sum + carry;
+        carry            = (sum < optional[w]) | (total < sum);
+        d[w] |= total ^ optional[w];
+    }
+}
+
+template <size_t kWords>
+void step(
+    bits<kWords>& d,
+    uint64_t const* mask,
+    bits<kWords> const& loop,
+    bits<kWords> const& optional) noexcept
+{
+    uint64_t carry = 0;
+    for (size_t w = 0; w < kWords; ++w) {
+        auto const t = d[w] & mask[w];
+        d[w]         = t << 1 | carry | (t & loop[w]);
+        carry        = t >> 63;
+    }
+    close(d, optional);
+}
+
+} // namespace
+
+namespace regexp::detail
+{
+
+shift_and::shift_and(nfa const& automaton)
+    : accepting_(automaton.accepting())
+{
+    if (automaton.accepting() > max_positions)
+        throw std::invalid_argument("pattern is too large for the bit-parallel engine");
+
+    words_ = std::bit_ceil(size_t{accepting_} / 64 + 1);
+    masks_.assign(256 * words_, 0);
+    optional_.assign(words_, 0);
+    loop_.assign(words_, 0);
+    start_.assign(words_, 0);
+
+    auto const set = [](uint64_t* v, size_t b) { v[b / 64] |= uint64_t{1} << b % 64; };
+
+    auto const& positions = automaton.positions();
+    for (size_t b = 0; b < positions.size(); ++b) {
+        for (size_t c = 0; c < 256; ++c) {
+            if (positions[b].cs.test(static_cast<char>(c)))
+                set(masks_.data() + c * words_, b);
+        }
+        if (positions[b].optional)
+            set(optional_.data(), b);
+        if (positions[b].loop)
+            set(loop_.data(), b);
+    }
+
+    set(start_.data(), 0);
+    for (size_t b = 0; b < positions.size() && positions[b].optional; ++b)
+        set(start_.data(), b + 1);
+}
+
+template <size_t kWords>
+bool shift_and::run(std::string_view s, bool unanchored) const noexcept
+{
+    auto const start    = load<kWords>(start_);
+    auto const loop     = load<kWords>(loop_);
+    auto const optional = load<kWords>(optional_);
+    auto const accepted = [&](bits<kWords> const& d) {
+        return d[accepting_ / 64] >> accepting_ % 64 & 1;
+    };
+
+    auto d = start;
+    if (unanchored) {
+        for (auto const c : s) {
+            if (accepted(d))
+                return true;
+            step(d, masks_.data() + static_cast<unsigned char>(c) * kWords, loop, optional);
+            for (size_t w = 0; w < kWords; ++w)
+                d[w] |= start[w];
+        }
+    } else {
+        for (auto const c : s) {
+            step(d, masks_.data() + static_cast<unsigned char>(c) * kWords, loop, optional);
+            if (std::all_of(d.cbegin(), d.cend(), [](uint64_t w) { return 0 == w; }))
+                return false;
+        }
+    }
+    return accepted(d);
+}
+
+bool shift_and::match(std::string_view s) const noexcept
+{
+    switch (words_) {
+        case 1:
+            return run<1>(s, false);
+        case 2:
+            return run<2>(s, false);
+        default:
+            return run<4>(s, false);
+    }
+}
+
+bool shift_and::search(std::string_view s) const noexcept
+{
+    switch (words_) {
+        case 1:
+            return run<1>(s, true);
+        case 2:
+            return run<2>(s, true);
+        default:
+            return run<4>(s, true);
+    }
+}
+
+} // namespace regexp::detail
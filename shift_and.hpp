@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <string_view>
+#include <vector>
+
+#include "nfa.hpp"
+
+namespace regexp::detail
+{
+
+/*
+ * Bit-parallel simulation of a small position automaton. Every boundary is
+ * a bit of up to four machine words and a byte is consumed without
+ * branches: the active boundaries whose position accepts the byte are
+ * shifted past it, looping positions keep theirs, and an addition carries
+ * the result over every run of optional positions at once.
+ */
+class shift_and
+{
+public:
+    static constexpr size_t max_positions = 255;
+
+    // throws std::invalid_argument when the automaton has more than max_positions positions
+    explicit shift_and(nfa const& automaton);
+
+    bool match(std::string_view s) const noexcept;
+    bool search(std::string_view s) const noexcept;
+
+private:
+    template <size_t kWords>
+    bool run(std::string_view s, bool unanchored) const noexcept;
+
+    size_t words_;
+    uint32_t accepting_;
+    // masks of the boundaries in front of a position accepting a byte, words_ words per byte
+    std::vector<uint64_t> masks_;
+    std::vector<uint64_t> optional_;
+    std::vector<uint64_t> loop_;
+    std::vector<uint64_t> start_;
+};
+
+} // namespace regexp::detail
@@ -0,0 +1,232 @@
+#include "span.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <bit>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(__SSE2__)
+#include <immintrin.h>
+#define REGEXP_SPAN_X86 1
+#endif
+
+#include "matcher.hpp"
+
+namespace
+{
+
+using namespace regexp::detail;
+
+bool class_test(span_table const& t, unsigned char b) noexcept
+{
+    auto const mask = b & 0x80 ? t.upper[b & 0xf] : t.lower[b & 0xf];
+    return mask >> (b >> 4 & 0x7) & 1;
+}
+
+size_t span_char_scalar(char const* s, size_t n, char c) noexcept
+{
+    size_t i = 0;
+    for (; i < n && c == s[i]; ++i)
+        ;
+    return i;
+}
+
+size_t span_class_scalar(char const* s, size_t n, span_table const& t) noexcept
+{
+    size_t i = 0;
+    for (; i < n && class_test(t, static_cast<unsigned char>(s[i])); ++i)
+        ;
+    return i;
+}
+
+size_t find_literal_scalar(char const* s, size_t n, std::string_view needle) noexcept
+{
+    auto const* const p = static_cast<char const*>(::memmem(s, n, needle.data(), needle.size()));
+    if (p)
+        return static_cast<size_t>(p - s);
+    return n;
+}
+
+#ifdef REGEXP_SPAN_X86
+
+size_t span_char_sse2(char const* s, size_t n, char c) noexcept
+{
+    auto const needle = _mm_set1_epi8(c);
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        auto const v    = _mm_loadu_si128(reinterpret_cast<__m128i const*>(s + i));
+        auto const mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle)));
+        if (0xffff != mask)
+            return i + std::countr_one(mask);
+    }
+
+    return i + span_char_scalar(s + i, n - i, c);
+}
+
+__attribute__((target("avx2"))) size_t span_char_avx2(char const* s, size_t n, char c) noexcept
+{
+    auto const needle = _mm256_set1_epi8(c);
+
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        auto const v    = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(s + i));
+        auto const mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle)));
+        if (0xffffffff != mask)
+            return i + std::countr_one(mask);
+    }
+
+    return i + span_char_sse2(s + i, n - i, c);
+}
+
+/*
+ * Truffle-style class test: two in-lane shuffles fetch the nibble masks of
+ * the lower and upper half of the byte range, a third one turns the high
+ * nibble into the bit to test.
+ */
+__attribute__((target("avx2"))) size_t
+span_class_avx2(char const* s, size_t n, span_table const& t) noexcept
+{
+    auto const lower = _mm256_broadcastsi128_si256(
+        _mm_load_si128(reinterpret_cast<__m128i const*>(t.lower.data())));
+    auto const upper = _mm256_broadcastsi128_si256(
+        _mm_load_si128(reinterpret_cast<__m128i const*>(t.upper.data())));
+    /* clang-format off */
+    auto const bits = _mm256_setr_epi8(
+        1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+        1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    /* clang-format on */
+    auto const highest = _mm256_set1_epi8(-128);
+    auto const nibble  = _mm256_set1_epi8(0x0f);
+    auto const zero    = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        auto const v    = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(s + i));
+        auto const m    = _mm256_or_si256(
+            _mm256_shuffle_epi8(lower, v),
+            _mm256_shuffle_epi8(upper, _mm256_xor_si256(v, highest)));
+        auto const bit  =
+            _mm256_shuffle_epi8(bits, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+        auto const miss = _mm256_cmpeq_epi8(_mm256_and_si256(m, bit), zero);
+        if (auto const mask = static_cast<uint32_t>(_mm256_movemask_epi8(miss)))
+            return i + std::countr_zero(mask);
+    }
+
+    return i + span_class_scalar(s + i, n - i, t);
+}
+
+/*
+ * Candidate positions are those where both the first and the last byte of
+ * the needle match, only they are verified with a memcmp.
+ */
+size_t find_literal_sse2(char const* s, size_t n, std::string_view needle) noexcept
+{
+    auto const k = needle.size();
+    if (1 == k) {
+        auto const* const p = static_cast<char const*>(std::memchr(s, needle[0], n));
+        return p ? static_cast<size_t>(p - s) : n;
+    }
+
+    auto const first = _mm_set1_epi8(needle.front());
+    auto const last  = _mm_set1_epi8(needle.back());
+
+    size_t i = 0;
+    for (; i + k - 1 + 16 <= n; i += 16) {
+        auto const f  = _mm_loadu_si128(reinterpret_cast<__m128i const*>(s + i));
+        auto const l  = _mm_loadu_si128(reinterpret_cast<__m128i const*>(s + i + k - 1));
+        auto mask     = static_cast<uint32_t>(_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(f, first), _mm_cmpeq_epi8(l, last))));
+        for (; mask; mask &= mask - 1) {
+            auto const j = i + std::countr_zero(mask);
+            if (0 == std::memcmp(s + j + 1, needle.data() + 1, k - 2))
+                return j;
+        }
+    }
+
+    return i + find_literal_scalar(s + i, n - i, needle);
+}
+
+__attribute__((target("avx2"))) size_t
+find_literal_avx2(char const* s, size_t n, std::string_view needle) noexcept
+{
+    auto const k = needle.size();
+    if (1 == k) {
+        auto const* const p = static_cast<char const*>(std::memchr(s, needle[0], n));
+        return p ? static_cast<size_t>(p - s) : n;
+    }
+
+    auto const first = _mm256_set1_epi8(needle.front());
+    auto const last  = _mm256_set1_epi8(needle.back());
+
+    size_t i = 0;
+    for (; i + k - 1 + 32 <= n; i += 32) {
+        auto const f = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(s + i));
+        auto const l = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(s + i + k - 1));
+        auto mask    = static_cast<uint32_t>(_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(f, first), _mm256_cmpeq_epi8(l, last))));
+        for (; mask; mask &= mask - 1) {
+            auto const j = i + std::countr_zero(mask);
+            if (0 == std::memcmp(s + j + 1, needle.data() + 1, k - 2))
+                return j;
+        }
+    }
+
+    return i + find_literal_sse2(s + i, n - i, needle);
+}
+
+#endif
+
+struct kernels {
+    size_t (*span_char)(char const*, size_t, char) noexcept;
+    size_t (*span_class)(char const*, size_t, span_table const&) noexcept;
+    size_t (*find_literal)(char const*, size_t, std::string_view) noexcept;
+};
+
+kernels select_kernels() noexcept
+{
+#ifdef REGEXP_SPAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return {span_char_avx2, span_class_avx2, find_literal_avx2};
+    return {span_char_sse2, span_class_scalar, find_literal_sse2};
+#else
+    return {span_char_scalar, span_class_scalar, find_literal_scalar};
+#endif
+}
+
+kernels const selected = select_kernels();
+
+} // namespace
+
+namespace regexp::detail
+{
+
+span_table make_span_table(charset const& cs) noexcept
+{
+    span_table t;
+    for (unsigned b = 0; b < 256; ++b) {
+        if (cs.test(static_cast<char>(b)))
+            (b & 0x80 ? t.upper : t.lower)[b & 0xf] |= 1 << (b >> 4 & 0x7);
+    }
+    return t;
+}
+
+size_t span_char(char const* s, size_t n, char c) noexcept
+{
+    return selected.span_char(s, n, c);
+}
+
+size_t span_class(char const* s, size_t n, span_table const& t) noexcept
+{
+    return selected.span_class(s, n, t);
+}
+
+size_t find_literal(char const* s, size_t n, std::string_view needle) noexcept
+{
+    return n < needle.size() ? n : selected.find_literal(s, n, needle);
+}
+
+} // namespace regexp::detail
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <string_view>
+
+namespace regexp::detail
+{
+
+struct charset;
+
+/*
+ * Nibble lookup masks of a character class for vectorized membership tests:
+ * bit h of lower[l] is set when byte (h << 4 | l) is in the class, upper[l]
+ * holds the same for bytes 0x80 and above.
+ */
+struct span_table {
+    alignas(16) std::array<uint8_t, 16> lower{};
+    alignas(16) std::array<uint8_t, 16> upper{};
+};
+
+span_table make_span_table(charset const& cs) noexcept;
+
+// length of the longest prefix of [s, s + n) consisting of c only
+size_t span_char(char const* s, size_t n, char c) noexcept;
+
+// length of the longest prefix of [s, s + n) consisting of the class members only
+size_t span_class(char const* s, size_t n, span_table const& t) noexcept;
+
+// offset of the first occurrence of a non-empty needle in [s, s + n), n if there is none
+size_t find_literal(char const* s, size_t n, std::string_view needle) noexcept;
+
+} // namespace regexp::detail
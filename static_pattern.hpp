@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+
+#include <string_view>
+
+#include "converter.hpp"
+
+namespace regexp
+{
+
+/*
+ * A pattern converted at compile time: the matcher is a chain of functions
+ * specialized for every matcher of the table, without variant dispatch,
+ * handler tables or heap allocations, so it inlines into the caller.
+ * Invalid patterns fail to compile.
+ */
+template <detail::ct::fixed_string P>
+class static_pattern
+{
+public:
+    static constexpr std::string_view str() noexcept { return P.view(); }
+
+    static constexpr bool match(std::string_view s) noexcept
+    {
+        return match_from<0>(s.data(), s.data() + s.size());
+    }
+
+    constexpr bool operator()(std::string_view s) const noexcept { return match(s); }
+
+private:
+    static constexpr auto table = detail::ct::convert_to_table<P.size()>(P.view());
+
+    template <std::size_t I>
+    static constexpr bool match_from(char const* first, char const* last) noexcept
+    {
+        if constexpr (I == table.size) {
+            return first == last;
+        } else {
+            constexpr auto m = table.matchers[I];
+            auto const avail = static_cast<std::size_t>(last - first);
+
+            if constexpr (detail::ct::kind::range_strict == m.k) {
+                constexpr auto literal = P.view().substr(m.first, m.last - m.first);
+                if (avail < literal.size())
+                    return false;
+                for (std::size_t j = 0; j < literal.size(); ++j) {
+                    if ('.' != literal[j] && literal[j] != first[j])
+                        return false;
+                }
+                return match_from<I + 1>(first + literal.size(), last);
+            } else {
+                auto const max = avail < m.n ? avail : m.n;
+
+                std::size_t len = 0;
+                if constexpr (detail::ct::kind::any_char == m.k)
+                    len = max;
+                else
+                    for (; len < max && m.accepts(first[len]); ++len)
+                        ;
+
+                if (len < m.m)
+                    return false;
+
+                // the last matcher has to consume the rest of the input
+                if constexpr (I + 1 == table.size)
+                    return len == avail;
+
+                for (auto k = static_cast<std::size_t>(m.m); k <= len; ++k) {
+                    if (match_from<I + 1>(first + k, last))
+                        return true;
+                }
+                return false;
+            }
+        }
+    }
+};
+
+} // namespace regexp
@@ -1,10 +1,28 @@
+#include <cstdint>
+
+#include <algorithm>
+#include <initializer_list>
+#include <iterator>
+#include <latch>
+#include <optional>
+#include <random>
 #include <stdexcept>
+#include <string>
 #include <string_view>
+#include <thread>
+#include <vector>
 
 #include "regexplib.hpp"
+#include "static_pattern.hpp"
 
 #include "gtest/gtest.h"
 
+constexpr regexp::engine kEngines[] = {
+    regexp::engine::backtrack,
+    regexp::engine::nfa,
+    regexp::engine::dfa,
+};
+
 struct TestParam {
     std::string_view input;
     std::string_view pattern;
@@ -18,6 +36,20 @@ TEST_P(TestSuite1, Matches)
     EXPECT_NO_THROW({ EXPECT_TRUE(regexp::does_match(GetParam().input, GetParam().pattern)); });
 }
 
+TEST_P(TestSuite1, MatchesPrecompiled)
+{
+    // unplanned patterns run the engine asked for instead of a cheaper strategy
+    for (auto const e : kEngines) {
+        for (auto const plan : {true, false}) {
+            EXPECT_NO_THROW({
+                regexp::pattern const p(GetParam().pattern, {.engine = e, .plan = plan});
+                EXPECT_TRUE(p.match(GetParam().input));
+                EXPECT_TRUE(p.search(GetParam().input));
+            });
+        }
+    }
+}
+
 /* clang-format off */
 INSTANTIATE_TEST_SUITE_P(
     TestSuite1Instantiation,
@@ -81,7 +113,8 @@ INSTANTIATE_TEST_SUITE_P(
         TestParam{ .input = "\v",         .pattern = "\\v"                        },
         TestParam{ .input = "\f",         .pattern = "\\f"                        },
         // TestParam{ .input = "\0",         .pattern = "\\0"                        },
-        TestParam{ .input = "\\",         .pattern = "\\\\"                       }
+        TestParam{ .input = "\\",         .pattern = "\\\\"                       },
+        TestParam{ .input = "xxx1",       .pattern = "x{0,3}.?1"                  }
     )
 );
 /* clang-format on */
@@ -94,6 +127,18 @@ TEST_P(TestSuite2, DoesNotMatch)
     EXPECT_NO_THROW({ EXPECT_FALSE(regexp::does_match(GetParam().input, GetParam().pattern)); });
 }
 
+TEST_P(TestSuite2, DoesNotMatchPrecompiled)
+{
+    for (auto const e : kEngines) {
+        for (auto const plan : {true, false}) {
+            EXPECT_NO_THROW({
+                regexp::pattern const p(GetParam().pattern, {.engine = e, .plan = plan});
+                EXPECT_FALSE(p.match(GetParam().input));
+            });
+        }
+    }
+}
+
 /* clang-format off */
 INSTANTIATE_TEST_SUITE_P(
     TestSuite2Instantiation,
@@ -141,6 +186,12 @@ TEST_P(TestSuite3, ThrowsInvalidArgument)
         std::invalid_argument);
 }
 
+TEST_P(TestSuite3, PrecompiledThrowsInvalidArgument)
+{
+    for (auto const e : kEngines)
+        EXPECT_THROW({ regexp::pattern(GetParam(), e); }, std::invalid_argument);
+}
+
 /* clang-format off */
 INSTANTIATE_TEST_SUITE_P(
     TestSuite3Instantiation,
@@ -180,3 +231,805 @@ INSTANTIATE_TEST_SUITE_P(
     )
 );
 /* clang-format on */
+
+struct TestSuite4 : testing::TestWithParam<TestParam> {
+};
+
+TEST_P(TestSuite4, Searches)
+{
+    for (auto const e : kEngines) {
+        EXPECT_NO_THROW({
+            regexp::pattern const p(GetParam().pattern, e);
+            EXPECT_TRUE(p.search(GetParam().input));
+            EXPECT_FALSE(p.match(GetParam().input));
+        });
+    }
+}
+
+/* clang-format off */
+INSTANTIATE_TEST_SUITE_P(
+    TestSuite4Instantiation,
+    TestSuite4,
+    testing::Values(
+        TestParam{ .input = "xaay",       .pattern = "aa"         },
+        TestParam{ .input = "aab",        .pattern = "a"          },
+        TestParam{ .input = "baa",        .pattern = "a+"         },
+        TestParam{ .input = "yyyyyy",     .pattern = "y{4,5}"     },
+        TestParam{ .input = "key=42;",    .pattern = "\\d+"       },
+        TestParam{ .input = "x abc y",    .pattern = "[abc]{3}"   },
+        TestParam{ .input = "ab",         .pattern = "b*"         }
+    )
+);
+/* clang-format on */
+
+TEST(Nfa, StaysLinearOnPathologicalPatterns)
+{
+    regexp::pattern const p{"[ab]*[ab]*[ab]*[ab]*[ab]*[ab]*[ab]*[ab]*c", regexp::engine::nfa};
+    std::string const s(1 << 16, 'a');
+    EXPECT_FALSE(p.match(s));
+    EXPECT_FALSE(p.search(s));
+    EXPECT_TRUE(p.match(s + 'c'));
+}
+
+TEST(Nfa, AgreesWithBacktrackerAcrossMachineWords)
+{
+    // a single word, two words, four words and beyond the bit-parallel limit
+    for (auto const* const p : {"a{0,40}b?c", "a{0,90}b[bc]*", "[ab]{150,200}c", "a{1,300}b"}) {
+        regexp::pattern const nfa{p, regexp::engine::nfa};
+        regexp::pattern const backtrack{p, regexp::engine::backtrack};
+        for (std::size_t n : {0, 1, 39, 40, 41, 63, 64, 65, 90, 91, 127, 128, 149, 150, 200, 301}) {
+            for (auto const* const tail : {"", "b", "c", "bc", "bcbb", "x"}) {
+                auto const s = std::string(n, 'a') + tail;
+                EXPECT_EQ(backtrack.match(s), nfa.match(s)) << p << " on " << s;
+                EXPECT_EQ(backtrack.search(s), nfa.search(s)) << p << " on " << s;
+                EXPECT_EQ(backtrack.search("xy" + s), nfa.search("xy" + s)) << p << " on " << s;
+            }
+        }
+    }
+}
+
+TEST(Nfa, RejectsTooLargePatterns)
+{
+    EXPECT_THROW({ regexp::pattern("a{1,100000}", regexp::engine::nfa); }, std::invalid_argument);
+    EXPECT_NO_THROW({ regexp::pattern("a{1,100000}", regexp::engine::backtrack); });
+}
+
+TEST(Dfa, StaysCorrectWhenCacheIsFlushed)
+{
+    std::string s;
+    for (int i = 0; i < 4096; ++i)
+        s += "ab"[(i * 7 + i / 3) % 2];
+
+    for (std::size_t const cache_size : {1, 4096}) {
+        regexp::options const opts{.engine = regexp::engine::dfa, .dfa_cache_size = cache_size};
+        regexp::pattern const p{"[ab]*a[ab]{8}c", opts};
+
+        EXPECT_FALSE(p.match(s));
+        EXPECT_TRUE(p.match(s + "aaaaaaaaac"));
+        EXPECT_FALSE(p.search(s));
+        EXPECT_TRUE(p.search(s + "aaaaaaaaacxyz"));
+    }
+}
+
+TEST(Prefilter, CountsRejectedInputs)
+{
+    regexp::pattern const p{"ERROR.*timeout\\d+ms", {.count_prefilter = true}};
+    regexp::pattern const uncounted{"ERROR.*timeout\\d+ms"};
+
+    EXPECT_FALSE(uncounted.match("INFO all good, nothing to report"));
+    EXPECT_EQ(0, uncounted.prefilter().misses);
+
+    EXPECT_FALSE(p.match("INFO all good, nothing to report"));
+    EXPECT_FALSE(p.match("ERROR connection refused"));
+    EXPECT_TRUE(p.match("ERROR upstream timeout30ms"));
+    EXPECT_TRUE(p.search("2024-01-01 ERROR db timeout5ms retrying"));
+    EXPECT_FALSE(p.search("2024-01-01 WARN db timed out after 5ms"));
+
+    auto const stats = p.prefilter();
+    EXPECT_EQ(2, stats.hits);
+    EXPECT_EQ(3, stats.misses);
+}
+
+TEST(Prefilter, KeepsLiteralsAcrossRepetitions)
+{
+    for (auto const e : kEngines) {
+        regexp::pattern const p{"ab{2,4}c.d{3}", e};
+        EXPECT_TRUE(p.match("abbbcxddd"));
+        EXPECT_FALSE(p.match("abbbcxdd"));
+        EXPECT_FALSE(p.match("abcxddd"));
+        EXPECT_TRUE(p.search("__abbcxddd__"));
+        EXPECT_FALSE(p.search("__abbxcddd__"));
+    }
+}
+
+TEST(Optimizer, ReportsRewrites)
+{
+    auto const runs = regexp::pattern{"a*a+b{2}b?"}.optimizer();
+    EXPECT_EQ(2, runs.merged_runs);
+    EXPECT_EQ(3, runs.min_length);
+    EXPECT_EQ(std::nullopt, runs.max_length);
+
+    auto const literals = regexp::pattern{"[a]b\\tc{2}d"}.optimizer();
+    EXPECT_EQ(2, literals.folded_classes);
+    EXPECT_EQ(4, literals.merged_literals);
+    EXPECT_EQ(6, literals.min_length);
+    EXPECT_EQ(6, literals.max_length);
+
+    auto const dropped = regexp::pattern{"x{0}a.*[b]?[^a]{0,2}"}.optimizer();
+    EXPECT_EQ(3, dropped.dropped_repeats);
+    EXPECT_EQ(1, dropped.min_length);
+
+    auto const untouched = regexp::pattern{"a*a+b{2}b?", {.optimize = false}}.optimizer();
+    EXPECT_EQ(0, untouched.merged_runs);
+    EXPECT_EQ(0, untouched.min_length);
+}
+
+TEST(Optimizer, RejectsInputsOfImpossibleLengths)
+{
+    for (auto const e : kEngines) {
+        regexp::pattern const p{"[a][b]{2,3}\\d", e};
+        EXPECT_EQ(4, p.optimizer().min_length);
+        EXPECT_EQ(5, p.optimizer().max_length);
+        EXPECT_FALSE(p.match("ab1"));
+        EXPECT_TRUE(p.match("abb1"));
+        EXPECT_TRUE(p.match("abbb1"));
+        EXPECT_FALSE(p.match("abbbb1"));
+        EXPECT_FALSE(p.search("ab1"));
+        EXPECT_TRUE(p.search("xxabbb1y"));
+        EXPECT_EQ(std::nullopt, p.find("abb"));
+    }
+}
+
+TEST(Planner, PicksCheapestStrategy)
+{
+    auto const plan_of = [](char const* p, regexp::options const& opts = {}) {
+        return regexp::pattern{p, opts}.explain();
+    };
+
+    EXPECT_EQ(regexp::strategy::literal, plan_of("ab.{0}c", {.engine = regexp::engine::dfa}).match);
+    EXPECT_EQ(regexp::strategy::literal, plan_of("").search);
+    EXPECT_EQ(regexp::strategy::class_span, plan_of("[abc]{3,}").match);
+    EXPECT_EQ(regexp::strategy::class_span, plan_of(".*").search);
+    EXPECT_EQ(regexp::strategy::bit_parallel, plan_of("a*[ab]*b").match);
+    EXPECT_EQ(regexp::strategy::dfa, plan_of("a*[ab]*b", {.engine = regexp::engine::dfa}).match);
+    EXPECT_EQ(regexp::strategy::nfa, plan_of("a{300}b", {.engine = regexp::engine::nfa}).match);
+    EXPECT_EQ(regexp::strategy::nfa, plan_of("a{300}b").search);
+    EXPECT_EQ(regexp::strategy::backtrack, plan_of("a{300}b").match);
+    EXPECT_EQ(regexp::strategy::backtrack, plan_of("a*[ab]*b", {.memoize = true}).match);
+    EXPECT_EQ(regexp::strategy::backtrack, plan_of("abc", {.collect_stats = true}).match);
+    EXPECT_EQ(regexp::strategy::bit_parallel, plan_of("abc", {.plan = false}).search);
+
+    auto const plan = plan_of("a*[ab]*b", {.plan = false});
+    EXPECT_EQ(regexp::strategy::backtrack, plan.match);
+    EXPECT_EQ("planning is disabled", plan.reason);
+    EXPECT_EQ("the pattern is a single literal", plan_of("abc").reason);
+}
+
+TEST(Planner, SingleStepsAgreeWithEngines)
+{
+    for (auto const* const p : {"", "abc", "b{2,3}", "[ab]{2,}", "[^a]*", ".{1,2}", "\\d+"}) {
+        regexp::pattern const planned{p};
+        regexp::pattern const engine{p, {.plan = false}};
+        for (auto const* const s : {"", "a", "b", "bb", "abc", "xabcx", "bbbb", "aab1ba", "12a"}) {
+            EXPECT_EQ(engine.match(s), planned.match(s)) << p << " on " << s;
+            EXPECT_EQ(engine.search(s), planned.search(s)) << p << " on " << s;
+            EXPECT_EQ(engine.find(s), planned.find(s)) << p << " on " << s;
+        }
+    }
+}
+
+TEST(PatternSet, ReportsAllMatchingPatterns)
+{
+    regexp::pattern_set const set{
+        {"ERROR.*", ".*timeout.*", "\\w+", "x{2,100000}", ".*", "ERROR \\d+"}};
+    EXPECT_EQ(6, set.size());
+
+    EXPECT_EQ((std::vector<std::size_t>{0, 1, 4}), set.match("ERROR db timeout"));
+    EXPECT_EQ((std::vector<std::size_t>{0, 4, 5}), set.match("ERROR 42"));
+    EXPECT_EQ((std::vector<std::size_t>{2, 3, 4}), set.match("xxx"));
+    EXPECT_EQ((std::vector<std::size_t>{4}), set.match(""));
+    EXPECT_TRUE(set.match_any("anything"));
+
+    regexp::pattern_set const none{{"a+", "b+"}};
+    EXPECT_FALSE(none.match_any("ab"));
+    EXPECT_TRUE(none.match("c").empty());
+}
+
+TEST(PatternSet, AgreesWithSinglePatterns)
+{
+    std::mt19937 gen{7};
+
+    auto const pick = [&](auto const& items) { return items[gen() % std::size(items)]; };
+
+    char const* const atoms[]       = {"a", "b", ".", "[ab]", "\\d", "ab", "ba1", "1"};
+    char const* const quantifiers[] = {"", "", "*", "+", "?", "{2}", "{1,3}"};
+    char const inputs[]             = {'a', 'b', '1', 'c'};
+
+    std::vector<std::string> sources;
+    for (int i = 0; i < 200; ++i) {
+        std::string p;
+        for (auto k = gen() % 4 + 1; k; --k)
+            p += std::string{pick(atoms)} + pick(quantifiers);
+        sources.push_back(p);
+    }
+
+    regexp::pattern_set const set{{sources.begin(), sources.end()}};
+    std::vector<regexp::pattern> patterns{sources.begin(), sources.end()};
+
+    std::vector<std::size_t> ids;
+    for (int j = 0; j < 300; ++j) {
+        std::string s;
+        for (auto k = gen() % 7; k; --k)
+            s += pick(inputs);
+
+        std::vector<std::size_t> expected;
+        for (std::size_t id = 0; id < patterns.size(); ++id) {
+            if (patterns[id].match(s))
+                expected.push_back(id);
+        }
+
+        set.match(s, ids);
+        EXPECT_EQ(expected, ids) << s;
+    }
+}
+
+TEST(Backtrack, ScansLongRuns)
+{
+    char const* const patterns[] = {"x*y", "x{3,70}y", "[abc]*d", "[^abc]+a", "\\w*\\W", ".{5,}y"};
+
+    for (auto const* const pattern : patterns) {
+        regexp::pattern const bt{pattern, {.plan = false}};
+        regexp::pattern const nfa{pattern, regexp::engine::nfa};
+
+        for (std::size_t len = 0; len < 100; ++len) {
+            for (char const fill : {'x', 'b', 'e', '\x80', '\xff'}) {
+                for (char const stop : {'y', 'd', 'a', '%'}) {
+                    auto const s = std::string(len, fill) + stop;
+                    EXPECT_EQ(nfa.match(s), bt.match(s)) << pattern << " on " << s;
+                }
+            }
+        }
+    }
+}
+
+TEST(Search, FindsLeftmostLongestSpan)
+{
+    for (auto const e : kEngines) {
+        regexp::pattern const p{"a+b*", e};
+        EXPECT_EQ((regexp::match_span{2, 6}), regexp::search("xxaaabyaab", p));
+        EXPECT_EQ((regexp::match_span{0, 0}), regexp::search("xyz", regexp::pattern{"q*", e}));
+        EXPECT_EQ(std::nullopt, regexp::search("xyz", p));
+    }
+    EXPECT_EQ((regexp::match_span{3, 6}), regexp::search("id=123;", "\\d+"));
+}
+
+TEST(Search, FindsAllMatches)
+{
+    for (auto const e : kEngines) {
+        regexp::pattern const p{"\\d{2,3}", e};
+
+        std::vector<regexp::match_span> spans;
+        for (auto const& m : regexp::find_all("1 22 4444 55555x", p))
+            spans.push_back(m);
+
+        std::vector<regexp::match_span> const expected = {{2, 4}, {5, 8}, {10, 13}, {13, 15}};
+        EXPECT_EQ(expected, spans);
+    }
+
+    regexp::pattern const empty{"a*"};
+    auto const all = regexp::find_all("baab", empty);
+    EXPECT_EQ(4, std::distance(all.begin(), all.end()));
+}
+
+TEST(Search, StaysLinearOnLongInputs)
+{
+    regexp::pattern const p{"[ab]*[ab]*[ab]*[ab]*c", regexp::engine::backtrack};
+    std::string const s(1 << 16, 'a');
+    EXPECT_EQ(std::nullopt, regexp::search(s, p));
+    EXPECT_EQ((regexp::match_span{0, s.size() + 1}), regexp::search(s + "c", p));
+}
+
+TEST(Search, FallsBackForPatternsTooLargeForAutomata)
+{
+    regexp::pattern const p{"xa{2,100000}"};
+    EXPECT_EQ((regexp::match_span{1, 5}), regexp::search("-xaaa-", p));
+    EXPECT_TRUE(p.search("-xaaa-"));
+
+    // finds agree with a pattern fitting in an automaton on inputs too short to tell them apart
+    std::mt19937 gen{5};
+    regexp::pattern const large{"[ab]*b{2}a?\\d{0,70000}x"};
+    regexp::pattern const small{"[ab]*b{2}a?\\d{0,12}x", regexp::engine::nfa};
+    for (int i = 0; i < 500; ++i) {
+        std::string s;
+        for (auto k = gen() % 12; k; --k)
+            s += "ab1x"[gen() % 4];
+        EXPECT_EQ(small.find(s), large.find(s)) << s;
+    }
+}
+
+TEST(Search, FindsManyMatchesOfPatternsTooLargeForAutomata)
+{
+    // a sweep over the whole input per match would take hours here
+    char const* const parts[] = {"abbx", "ba1x", "bb2", "a"};
+    std::mt19937 gen{7};
+    std::string s;
+    while (s.size() < (1 << 17))
+        s += parts[gen() % 4];
+
+    regexp::pattern const large{"[ab]*b{2}a?\\d{0,70000}x"};
+    regexp::pattern const small{"[ab]*b{2}a?\\d{0,12}x", regexp::engine::nfa};
+    std::vector<regexp::match_span> expected, spans;
+    for (auto const& m : regexp::find_all(s, small))
+        expected.push_back(m);
+    for (auto const& m : regexp::find_all(s, large))
+        spans.push_back(m);
+    EXPECT_GT(expected.size(), size_t{5000});
+    EXPECT_EQ(expected, spans);
+}
+
+TEST(Image, RoundTripsPatterns)
+{
+    char const* const patterns[] = {
+        "a*[ab]+\\d{2,3}", "ERROR.*timeout\\d+ms", "x[^y]?.{2}", "a{2,100000}",
+    };
+    std::string const inputs[] = {"", "ab12", "aab123", "ERROR: timeout5ms", "xz12", "aaa"};
+
+    for (auto const* const source : patterns) {
+        regexp::pattern const p{source};
+        auto const image = p.save();
+        for (auto const e : kEngines) {
+            if (std::string_view{source}.starts_with("a{") && regexp::engine::backtrack != e)
+                continue;
+            auto const loaded = regexp::pattern::load_from_memory(image, {.engine = e});
+            EXPECT_EQ(p.str(), loaded.str());
+            EXPECT_EQ(p.optimizer().min_length, loaded.optimizer().min_length);
+            EXPECT_EQ(p.optimizer().max_length, loaded.optimizer().max_length);
+            for (auto const& s : inputs) {
+                EXPECT_EQ(p.match(s), loaded.match(s)) << source << " on " << s;
+                EXPECT_EQ(p.search(s), loaded.search(s)) << source << " on " << s;
+                EXPECT_EQ(p.find(s), loaded.find(s)) << source << " on " << s;
+            }
+        }
+    }
+}
+
+TEST(Image, RoundTripsPatternSets)
+{
+    regexp::pattern_set const set{{"a*b", "\\d{3}", "xa{2,100000}", "[ab]+\\d"}};
+    auto const image  = set.save();
+    auto const loaded = regexp::pattern_set::load_from_memory(image);
+
+    EXPECT_EQ(set.size(), loaded.size());
+    for (auto const s : {"", "aab", "123", "xaaa", "ab1", "b", "12"})
+        EXPECT_EQ(set.match(s), loaded.match(s)) << s;
+    // a loaded set saves the programs it was loaded with
+    EXPECT_EQ(image, loaded.save());
+}
+
+TEST(Image, RejectsCorruptedImages)
+{
+    auto const image = regexp::pattern{"a*[ab]+\\d"}.save();
+
+    auto corrupted = image;
+    corrupted.back() ^= 1;
+    EXPECT_THROW(regexp::pattern::load_from_memory(corrupted), std::invalid_argument);
+    EXPECT_THROW(
+        regexp::pattern::load_from_memory(std::string_view{image}.substr(0, image.size() - 16)),
+        std::invalid_argument);
+    EXPECT_THROW(regexp::pattern_set::load_from_memory(image), std::invalid_argument);
+
+    std::string shifted(image.size() + 1, '\0');
+    std::copy(image.cbegin(), image.cend(), shifted.begin() + 1);
+    EXPECT_THROW(
+        regexp::pattern::load_from_memory(std::string_view{shifted}.substr(1)),
+        std::invalid_argument);
+}
+
+TEST(Backtrack, MemoizedStaysPolynomial)
+{
+    regexp::options const opts{.prefilter = false, .optimize = false, .memoize = true};
+    std::string const s(2000, 'a');
+
+    EXPECT_FALSE(regexp::pattern(".*.*.*.*.*.*[ab]*\\w*b", opts).match(s));
+    EXPECT_TRUE(regexp::pattern(".*.*.*.*.*.*[ab]*\\w*a", opts).match(s));
+    EXPECT_FALSE(regexp::pattern("a*a*a*a*a*a*a{2,}b", opts).match(s));
+    // inputs beyond the memo budget are still matched, only without it
+    EXPECT_TRUE(
+        regexp::pattern("a*a+", {.optimize = false, .memoize = true, .memo_size = 16}).match(s));
+}
+
+TEST(Jit, AgreesWithInterpreter)
+{
+    std::string const s = std::string(1000, 'a') + "0123456789abcdefXYZ" + std::string(100, 'b');
+    for (auto const p :
+         {".*0123456789abcdef[XY]+Z.*", "a{1000}\\d{10}\\w{6}XYZb*", "[ab]*\\d+.*"}) {
+        regexp::pattern const interpreted{p, {.plan = false}};
+        regexp::pattern const native{p, {.jit = true}};
+        EXPECT_FALSE(interpreted.jit_compile_time());
+#if defined(__x86_64__) && defined(__linux__)
+        EXPECT_TRUE(native.jit_compile_time()) << p;
+#endif
+        EXPECT_EQ(interpreted.match(s), native.match(s)) << p;
+        EXPECT_EQ(interpreted.match(s.substr(1)), native.match(s.substr(1))) << p;
+        EXPECT_EQ(interpreted.match(s + "!"), native.match(s + "!")) << p;
+    }
+}
+
+TEST(Backtrack, GivesUpWhenStepBudgetIsExhausted)
+{
+    std::string const s(30, 'a');
+    regexp::pattern const p{"a*[ab]*a*[ab]*a*[ab]*b", {.prefilter = false, .collect_stats = true}};
+
+    EXPECT_EQ(regexp::match_result::budget_exceeded, p.match(s, 1000));
+    EXPECT_EQ(regexp::match_result::no_match, p.match(s, 100000000));
+    EXPECT_EQ(regexp::match_result::match, p.match(s + "b", 1000));
+    regexp::pattern const automaton("b+", regexp::engine::nfa);
+    EXPECT_EQ(regexp::match_result::no_match, automaton.match(s, 1));
+
+    auto const st = p.stats();
+    EXPECT_EQ(3, st.calls);
+    EXPECT_EQ(1, st.budget_exceeded);
+    EXPECT_EQ(6, st.max_depth);
+    EXPECT_LT(1000, st.spec_char.visits + st.one_of_char.visits + st.range_strict.visits);
+    EXPECT_LT(0, st.one_of_char.backtracks);
+    EXPECT_LT(0, st.range_strict.bytes);
+    EXPECT_EQ(0, st.any_char.visits);
+}
+
+TEST(Backtrack, DoesNotReadPastShortInput)
+{
+    EXPECT_FALSE(regexp::does_match("aa", "aa."));
+    EXPECT_FALSE(regexp::does_match("a", "abc"));
+}
+
+TEST(Backtrack, HandlesLongInputsWithinDepthLimit)
+{
+    regexp::pattern const p{
+        "a*b*\\w?c", {.prefilter = false, .plan = false, .max_backtrack_depth = 3}};
+    std::string const s(1 << 20, 'a');
+    EXPECT_FALSE(p.match(s));
+    EXPECT_TRUE(p.match(s + "bbc"));
+
+    EXPECT_THROW(
+        (regexp::pattern{"a*[ab]*b*c*", {.plan = false, .max_backtrack_depth = 3}}),
+        std::invalid_argument);
+    // the planned pattern never runs the backtracker
+    EXPECT_NO_THROW((regexp::pattern{"a*[ab]*b*c*", {.max_backtrack_depth = 3}}));
+    EXPECT_NO_THROW(
+        (regexp::pattern{
+            "a*[ab]*b*c*", {.engine = regexp::engine::nfa, .max_backtrack_depth = 3}}));
+}
+
+TEST(Batch, AgreesWithRowByRowMatching)
+{
+    std::mt19937 gen{7};
+    char const inputs[] = {'a', 'b', '1', 'x'};
+
+    std::string data;
+    std::vector<std::size_t> offsets{0};
+    for (int i = 0; i < 40003; ++i) {
+        for (auto k = gen() % 8; k; --k)
+            data += inputs[gen() % std::size(inputs)];
+        offsets.push_back(data.size());
+    }
+    auto const count = offsets.size() - 1;
+
+    for (auto const p : {"a[ab]*1?x*", "\\w*1\\w*", "b.{2,}"}) {
+        for (auto const e : kEngines) {
+            regexp::pattern const pattern{p, e};
+            for (auto const jobs : {1u, 4u}) {
+                std::vector<std::uint64_t> bits((count + 63) / 64, ~std::uint64_t{0});
+                pattern.match_batch(data.data(), offsets.data(), count, bits.data(), jobs);
+
+                for (std::size_t i = 0; i < count; ++i) {
+                    std::string_view const row{
+                        data.data() + offsets[i], offsets[i + 1] - offsets[i]};
+                    ASSERT_EQ(pattern.match(row), bits[i / 64] >> i % 64 & 1) << p << " on " << row;
+                }
+                EXPECT_EQ(0, bits.back() >> count % 64);
+            }
+        }
+    }
+}
+
+TEST(Stream, AgreesWithContiguousInput)
+{
+    std::mt19937 gen{11};
+    char const inputs[] = {'a', 'b', '1', 'x'};
+
+    for (auto const p : {"a[ab]*1?x*", "\\w*1\\w*", "b.{2,}", "ab1", "x{2,100000}"}) {
+        regexp::pattern const pattern{p};
+        regexp::stream_matcher full{pattern};
+        regexp::stream_matcher partial{pattern, regexp::stream_matcher::mode::search};
+
+        for (int j = 0; j < 200; ++j) {
+            std::string s;
+            for (auto k = gen() % 12; k; --k)
+                s += inputs[gen() % std::size(inputs)];
+
+            for (std::size_t first = 0; first < s.size();) {
+                auto const chunk = std::string_view{s}.substr(first, gen() % 4 + 1);
+                full.feed(chunk);
+                partial.feed(chunk);
+                first += chunk.size();
+            }
+
+            EXPECT_EQ(pattern.match(s), full.finish()) << p << " on " << s;
+            EXPECT_EQ(pattern.search(s), partial.finish()) << p << " on " << s;
+        }
+    }
+}
+
+TEST(PatternCache, ReusesCompiledPatterns)
+{
+    regexp::set_pattern_cache_capacity(32);
+    auto const before = regexp::pattern_cache_stats();
+
+    EXPECT_TRUE(regexp::does_match("abc", "a[bc]+"));
+    EXPECT_TRUE(regexp::does_match("acb", "a[bc]+"));
+    EXPECT_FALSE(regexp::does_match("abd", "a[bc]+"));
+    EXPECT_EQ((regexp::match_span{1, 3}), regexp::search("xabx", "a[bc]+"));
+
+    auto const after = regexp::pattern_cache_stats();
+    EXPECT_EQ(before.misses + 1, after.misses);
+    EXPECT_EQ(before.hits + 3, after.hits);
+    EXPECT_EQ(32, after.capacity);
+
+    regexp::set_pattern_cache_capacity(256);
+}
+
+TEST(PatternCache, EvictsLeastRecentlyUsedPatterns)
+{
+    regexp::set_pattern_cache_capacity(0);
+    auto const before = regexp::pattern_cache_stats();
+    EXPECT_EQ(0, before.size);
+
+    EXPECT_TRUE(regexp::does_match("aa", "a+"));
+    EXPECT_TRUE(regexp::does_match("aa", "a+"));
+    EXPECT_EQ(before.misses + 2, regexp::pattern_cache_stats().misses);
+
+    regexp::set_pattern_cache_capacity(16);
+    for (int i = 0; i < 100; ++i)
+        EXPECT_TRUE(regexp::does_match(std::to_string(i), std::to_string(i) + "x*"));
+
+    auto const after = regexp::pattern_cache_stats();
+    EXPECT_EQ(16, after.size);
+    EXPECT_LE(before.evictions + 100 - 16, after.evictions);
+    EXPECT_THROW(regexp::does_match("a", "a{2,1}"), std::invalid_argument);
+
+    // a touched pattern outlives the ones inserted before it
+    regexp::set_pattern_cache_capacity(3);
+    for (auto const* const p : {"a+", "b+", "c+", "a+", "d+"})
+        regexp::does_match("", p);
+    auto const touched = regexp::pattern_cache_stats();
+    EXPECT_EQ(3, touched.size);
+    EXPECT_FALSE(regexp::does_match("", "a+"));
+    EXPECT_EQ(touched.hits + 1, regexp::pattern_cache_stats().hits);
+    EXPECT_FALSE(regexp::does_match("", "b+"));
+    EXPECT_EQ(touched.misses + 1, regexp::pattern_cache_stats().misses);
+
+    regexp::set_pattern_cache_capacity(256);
+}
+
+TEST(PatternCache, IsSharedBetweenThreads)
+{
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([t] {
+            for (int i = 0; i < 500; ++i) {
+                auto const p = "x" + std::to_string((i + t) % 40) + "y*";
+                EXPECT_TRUE(regexp::does_match("x" + std::to_string((i + t) % 40) + "yy", p));
+                if (0 == i % 100)
+                    regexp::set_pattern_cache_capacity(8 + i / 10);
+            }
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+
+    EXPECT_GE(regexp::pattern_cache_stats().capacity, regexp::pattern_cache_stats().size);
+    regexp::set_pattern_cache_capacity(256);
+}
+
+TEST(Scratch, SharedPatternsAgreeAcrossThreads)
+{
+    std::vector<regexp::pattern> patterns;
+    patterns.emplace_back("ERROR");
+    patterns.emplace_back("[abc]{2,}");
+    patterns.emplace_back("a*[ab]*b\\d?");
+    patterns.emplace_back("a*[ab]*b\\d?", regexp::options{.plan = false});
+    patterns.emplace_back("a*[ab]*b\\d?", regexp::options{.memoize = true});
+    patterns.emplace_back("a*[ab]*b\\d?", regexp::options{.jit = true});
+    patterns.emplace_back("[ab]*a[ab]{3}1?", regexp::engine::nfa);
+    patterns.emplace_back(
+        "[ab]*a[ab]{3}1?", regexp::options{.engine = regexp::engine::dfa, .dfa_cache_size = 1});
+    patterns.emplace_back(".*b[ab]{2}", regexp::engine::dfa);
+    patterns.emplace_back("a{1,300}b", regexp::engine::nfa);
+    regexp::pattern_set const set{{"[ab]*a[ab]{3}1?", ".*b[ab]{2}", "a{1,300}b", "ERROR"}};
+
+    std::mt19937 gen{11};
+    std::vector<std::string> inputs;
+    for (int i = 0; i < 32; ++i) {
+        std::string s;
+        for (auto k = gen() % 40; k; --k)
+            s += "ab1cE"[gen() % 5];
+        inputs.push_back(std::move(s));
+    }
+    inputs.push_back("ERROR");
+    inputs.push_back(std::string(99, 'a') + 'b');
+
+    // the inputs as a column for match_batch
+    std::string column;
+    std::vector<std::size_t> offsets{0};
+    for (auto const& s : inputs) {
+        column += s;
+        offsets.push_back(column.size());
+    }
+
+    // expected results of separately compiled patterns on a single thread
+    std::vector<bool> matches, searches;
+    std::vector<std::optional<regexp::match_span>> finds;
+    std::vector<std::vector<std::size_t>> ids;
+    for (auto const& p : patterns) {
+        regexp::pattern const reference{p.str(), regexp::options{.plan = false}};
+        for (auto const& s : inputs) {
+            matches.push_back(reference.match(s));
+            searches.push_back(reference.search(s));
+            finds.push_back(reference.find(s));
+        }
+    }
+    for (auto const& s : inputs)
+        ids.push_back(set.match(s));
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&, t] {
+            // half of the threads bring a scratch of their own, shared by all the patterns
+            regexp::scratch sc;
+            std::vector<std::size_t> found;
+            for (int round = 0; round < 2; ++round) {
+                std::size_t k = 0;
+                for (auto const& p : patterns) {
+                    for (auto const& s : inputs) {
+                        if (t % 2) {
+                            EXPECT_EQ(matches[k], p.match(s, sc)) << p.str() << " on " << s;
+                            EXPECT_EQ(searches[k], p.search(s, sc)) << p.str() << " on " << s;
+                            EXPECT_EQ(finds[k], p.find(s, sc)) << p.str() << " on " << s;
+                        } else {
+                            EXPECT_EQ(matches[k], p.match(s)) << p.str() << " on " << s;
+                            EXPECT_EQ(searches[k], p.search(s)) << p.str() << " on " << s;
+                            EXPECT_EQ(finds[k], p.find(s)) << p.str() << " on " << s;
+                        }
+                        ++k;
+                    }
+                }
+                for (std::size_t i = 0; i < patterns.size(); ++i) {
+                    std::vector<std::uint64_t> bits((inputs.size() + 63) / 64);
+                    patterns[i].match_batch(
+                        column.data(), offsets.data(), inputs.size(), bits.data());
+                    for (std::size_t j = 0; j < inputs.size(); ++j) {
+                        EXPECT_EQ(matches[i * inputs.size() + j], bits[j / 64] >> j % 64 & 1)
+                            << patterns[i].str() << " on " << inputs[j];
+                    }
+                }
+                for (std::size_t i = 0; i < inputs.size(); ++i) {
+                    set.match(inputs[i], found);
+                    EXPECT_EQ(ids[i], found) << inputs[i];
+                }
+            }
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+}
+
+TEST(Scratch, PoolsServeMoreThreadsThanSlots)
+{
+    // more callers at once than a pool has slots on this machine
+    auto const qty = 4 * std::max(8u, std::thread::hardware_concurrency());
+    regexp::pattern const small_cache{
+        ".*b[ab]{2}", regexp::options{.engine = regexp::engine::dfa, .dfa_cache_size = 1}};
+    regexp::pattern const dfa{"[ab]*a[ab]{3}1?", regexp::engine::dfa};
+
+    std::latch start{qty};
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < qty; ++t) {
+        threads.emplace_back([&] {
+            start.arrive_and_wait();
+            for (int i = 0; i < 20; ++i) {
+                EXPECT_TRUE(small_cache.match("aabab"));
+                EXPECT_FALSE(small_cache.match("abaab"));
+                EXPECT_TRUE(dfa.search("xxbaabb1"));
+                EXPECT_FALSE(dfa.match("bbbb"));
+            }
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+}
+
+static_assert(regexp::static_pattern<"[abc]{2,5}\\d+">::match("cab42"));
+static_assert(!regexp::static_pattern<"[abc]{2,5}\\d+">::match("cabcab42"));
+
+template <typename StaticPattern>
+void expect_agrees_with_runtime_pattern(std::initializer_list<std::string_view> inputs)
+{
+    regexp::pattern const p{StaticPattern::str()};
+    for (auto const s : inputs)
+        EXPECT_EQ(p.match(s), StaticPattern::match(s)) << StaticPattern::str() << " on " << s;
+}
+
+TEST(StaticPattern, AgreesWithRuntimePattern)
+{
+    std::initializer_list<std::string_view> const inputs = {
+        "", "a", "aa", "ab", "abc", "aabc012ef", "1122334455", "yyy", "yyyyyy", "a?", "a*",
+        "\\t", "x1y", "x\ty", "ab12", "cab42",
+    };
+
+    expect_agrees_with_runtime_pattern<regexp::static_pattern<"a*a+b+c*.*.+">>(inputs);
+    expect_agrees_with_runtime_pattern<regexp::static_pattern<"[123]*[123]+.*[12].+[43].+">>(
+        inputs);
+    expect_agrees_with_runtime_pattern<regexp::static_pattern<"y{3,}">>(inputs);
+    expect_agrees_with_runtime_pattern<regexp::static_pattern<"y{,5}">>(inputs);
+    expect_agrees_with_runtime_pattern<regexp::static_pattern<"[^abc]{1,2}.">>(inputs);
+    expect_agrees_with_runtime_pattern<regexp::static_pattern<"a[?c]?">>(inputs);
+    expect_agrees_with_runtime_pattern<regexp::static_pattern<"[a*]{,2}">>(inputs);
+    expect_agrees_with_runtime_pattern<regexp::static_pattern<"\\\\\\w">>(inputs);
+    expect_agrees_with_runtime_pattern<regexp::static_pattern<"x\\s?\\d*y">>(inputs);
+    expect_agrees_with_runtime_pattern<regexp::static_pattern<"a.b*.?">>(inputs);
+    expect_agrees_with_runtime_pattern<regexp::static_pattern<"x{0,3}.?1">>(inputs);
+    expect_agrees_with_runtime_pattern<regexp::static_pattern<"[abc]{2,5}\\d+">>(inputs);
+}
+
+TEST(Engines, AgreeOnRandomPatterns)
+{
+    std::mt19937 gen{42};
+
+    auto const pick = [&](auto const& items) { return items[gen() % std::size(items)]; };
+
+    char const* const atoms[] = {"a", "b", ".", "[ab]", "[^a]", "[b]", "\\d", "ab", "a.b", "ba1"};
+    char const* const quantifiers[] = {
+        "", "", "*", "+", "?", "{0}", "{2}", "{1,3}", "{2,}", "{,2}",
+    };
+    char const inputs[] = {'a', 'b', '1', 'c'};
+
+    for (int i = 0; i < 500; ++i) {
+        std::string p;
+        for (auto k = gen() % 5 + 1; k; --k)
+            p += std::string{pick(atoms)} + pick(quantifiers);
+
+        std::vector<regexp::pattern> ps;
+        ps.emplace_back(
+            p,
+            regexp::options{
+                .engine    = regexp::engine::backtrack,
+                .prefilter = false,
+                .optimize  = false,
+                .plan      = false,
+            });
+        ps.emplace_back(p, regexp::options{.memoize = true, .memo_size = 256});
+        ps.emplace_back(p, regexp::options{.prefilter = false, .jit = true});
+        for (auto const e : kEngines)
+            ps.emplace_back(p, e);
+
+        for (int j = 0; j < 20; ++j) {
+            std::string s;
+            for (auto k = gen() % 9; k; --k)
+                s += pick(inputs);
+
+            std::optional<regexp::match_span> leftmost_longest;
+            for (std::size_t first = 0; first <= s.size() && !leftmost_longest; ++first) {
+                for (auto last = first; last <= s.size(); ++last) {
+                    if (ps.front().match(std::string_view{s}.substr(first, last - first)))
+                        leftmost_longest = regexp::match_span{first, last};
+                }
+            }
+
+            for (auto const& other : ps) {
+                EXPECT_EQ(ps.front().match(s), other.match(s)) << p << " on " << s;
+                EXPECT_EQ(ps.front().search(s), other.search(s)) << p << " on " << s;
+                EXPECT_EQ(leftmost_longest, other.find(s)) << p << " on " << s;
+            }
+        }
+    }
+}